@@ -7,16 +7,19 @@
 
 #if defined(__cplusplus)
 struct alureStream;
+struct alureDecoder;
 extern "C" {
 #else
 typedef struct alureStream alureStream;
+typedef struct alureDecoder alureDecoder;
 #endif
 
-#define ALURE_VERSION_STRING "1.2"
+#define ALURE_VERSION_STRING "1.3"
 
 #define ALURE_VERSION_1_0
 #define ALURE_VERSION_1_1
 #define ALURE_VERSION_1_2
+#define ALURE_VERSION_1_3
 
 
 #ifndef ALURE_API
@@ -43,6 +46,26 @@ typedef struct alureStream alureStream;
  typedef uint64_t alureUInt64;
 #endif
 
+typedef struct alureIOStats {
+    alureUInt64 reads;
+    alureUInt64 bytesRead;
+    alureUInt64 seeks;
+    alureUInt64 seekDistance;
+    alureUInt64 callbackTime;
+} alureIOStats;
+
+typedef struct alureProbeInfo {
+    ALenum format;
+    ALuint frequency;
+    ALuint channels;
+    alureInt64 frames;
+} alureProbeInfo;
+
+#define ALURE_IO_OPEN  1
+#define ALURE_IO_READ  2
+#define ALURE_IO_SEEK  3
+#define ALURE_IO_CLOSE 4
+
 ALURE_API void ALURE_APIENTRY alureGetVersion(ALuint *major, ALuint *minor);
 ALURE_API const ALchar* ALURE_APIENTRY alureGetErrorString(void);
 
@@ -62,6 +85,26 @@ ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFile(const ALchar *fname);
 ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemory(const ALubyte *data, ALsizei length);
 ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromFile(const ALchar *fname, ALuint buffer);
 ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemory(const ALubyte *fdata, ALsizei length, ALuint buffer);
+ALURE_API ALsizei ALURE_APIENTRY alureCreateBuffersFromFiles(const ALchar *const *fnames, ALsizei count, ALuint *bufs);
+ALURE_API ALsizei ALURE_APIENTRY alureCreateBuffersFromMemory(const ALubyte *const *fdata, const ALsizei *lengths, ALsizei count, ALuint *bufs);
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryKeyed(const ALchar *key, const ALubyte *data, ALsizei length);
+ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemoryKeyed(const ALchar *key, const ALubyte *fdata, ALsizei length, ALuint buffer);
+ALURE_API ALboolean ALURE_APIENTRY alureSetBufferCacheSize(alureUInt64 size);
+ALURE_API ALboolean ALURE_APIENTRY alureSetDiskCacheDirectory(const ALchar *path);
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFileAsync(const ALchar *fname, void (*callback)(void *userdata, ALuint request, ALuint buffer), void *userdata);
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryAsync(const ALubyte *data, ALsizei length, void (*callback)(void *userdata, ALuint request, ALuint buffer), void *userdata);
+ALURE_API ALboolean ALURE_APIENTRY alureCancelBufferLoad(ALuint request);
+ALURE_API ALboolean ALURE_APIENTRY alureIsBufferLoadPending(ALuint request);
+ALURE_API ALuint ALURE_APIENTRY alureCreateSharedBufferFromFile(const ALchar *fname);
+ALURE_API ALuint ALURE_APIENTRY alureCreateSharedBufferFromMemory(const ALubyte *data, ALsizei length);
+ALURE_API ALboolean ALURE_APIENTRY alureReleaseSharedBuffer(ALuint buffer);
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFileRange(const ALchar *fname, alureUInt64 start, alureUInt64 end);
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryRange(const ALubyte *data, ALsizei length, alureUInt64 start, alureUInt64 end);
+ALURE_API ALboolean ALURE_APIENTRY alureSetMemoryBudget(alureUInt64 budget, void (*callback)(void *userdata, alureUInt64 used, alureUInt64 budget), void *userdata);
+ALURE_API alureUInt64 ALURE_APIENTRY alureGetMemoryUsage(void);
+ALURE_API ALboolean ALURE_APIENTRY alureRegisterEvictableBuffer(ALuint buffer, const ALchar *fname);
+ALURE_API ALboolean ALURE_APIENTRY alureUnregisterEvictableBuffer(ALuint buffer);
+ALURE_API ALboolean ALURE_APIENTRY alureTouchBuffer(ALuint buffer);
 
 ALURE_API alureStream* ALURE_APIENTRY alureCreateStreamFromFile(const ALchar *fname, ALsizei chunkLength, ALsizei numBufs, ALuint *bufs);
 ALURE_API alureStream* ALURE_APIENTRY alureCreateStreamFromMemory(const ALubyte *data, ALuint length, ALsizei chunkLength, ALsizei numBufs, ALuint *bufs);
@@ -76,6 +119,18 @@ ALURE_API ALsizei ALURE_APIENTRY alureBufferDataFromStream(alureStream *stream,
 ALURE_API ALboolean ALURE_APIENTRY alureRewindStream(alureStream *stream);
 ALURE_API ALboolean ALURE_APIENTRY alureSetStreamOrder(alureStream *stream, ALuint order);
 ALURE_API ALboolean ALURE_APIENTRY alureSetStreamPatchset(alureStream *stream, const ALchar *patchset);
+ALURE_API ALboolean ALURE_APIENTRY alureSetStreamOffset(alureStream *stream, alureUInt64 frame);
+ALURE_API alureInt64 ALURE_APIENTRY alureGetStreamOffset(alureStream *stream);
+ALURE_API ALboolean ALURE_APIENTRY alureGetStreamIOStats(alureStream *stream, alureIOStats *stats);
+ALURE_API ALboolean ALURE_APIENTRY alureProbeFile(const ALchar *fname, alureProbeInfo *info);
+ALURE_API ALboolean ALURE_APIENTRY alureProbeMemory(const ALubyte *fdata, ALuint length, alureProbeInfo *info);
+ALURE_API ALsizei ALURE_APIENTRY alureProbeFiles(const ALchar *const *fnames, ALsizei count, alureProbeInfo *infos);
+ALURE_API alureDecoder* ALURE_APIENTRY alureOpenDecoder(const ALchar *fname, ALuint bits, ALuint floatbits, alureProbeInfo *info);
+ALURE_API alureDecoder* ALURE_APIENTRY alureOpenDecoderFromMemory(const ALubyte *fdata, ALuint length, ALuint bits, ALuint floatbits, alureProbeInfo *info);
+ALURE_API ALsizei ALURE_APIENTRY alureReadFrames(alureDecoder *decoder, ALvoid *data, ALsizei frames);
+ALURE_API ALboolean ALURE_APIENTRY alureCloseDecoder(alureDecoder *decoder);
+ALURE_API ALboolean ALURE_APIENTRY alureDeferCallbacks(ALboolean defer);
+ALURE_API ALsizei ALURE_APIENTRY alurePollEvents(void);
 ALURE_API ALboolean ALURE_APIENTRY alureDestroyStream(alureStream *stream, ALsizei numBufs, ALuint *bufs);
 
 ALURE_API void ALURE_APIENTRY alureUpdate(void);
@@ -110,6 +165,15 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetIOCallbacksUserdata(
       ALsizei (*read)(void*,ALubyte*,ALuint),
       ALsizei (*write)(void*,const ALubyte*,ALuint),
       alureInt64 (*seek)(void*,alureInt64,int));
+ALURE_API ALboolean ALURE_APIENTRY alureSetReadAhead(ALuint size);
+ALURE_API alureUInt64 ALURE_APIENTRY alureGetBackendSeekCount(void);
+ALURE_API ALboolean ALURE_APIENTRY alureMountPack(const ALchar *fname);
+ALURE_API ALboolean ALURE_APIENTRY alureUnmountPack(const ALchar *fname);
+ALURE_API ALboolean ALURE_APIENTRY alureSetFileCacheSize(alureUInt64 size);
+ALURE_API ALboolean ALURE_APIENTRY alureGetIOStats(alureIOStats *stats);
+ALURE_API ALboolean ALURE_APIENTRY alureSetIOLogCallback(
+      void (*callback)(void *userdata, const ALchar *filename, ALenum event, alureInt64 offset, alureInt64 length),
+      void *userdata);
 
 ALURE_API void* ALURE_APIENTRY alureGetProcAddress(const ALchar *funcname);
 
@@ -125,6 +189,26 @@ typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMFILE)(const ALch
 typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMMEMORY)(const ALubyte*,ALsizei);
 typedef ALboolean       (ALURE_APIENTRY *LPALUREBUFFERDATAFROMFILE)(const ALchar *fname, ALuint buffer);
 typedef ALboolean       (ALURE_APIENTRY *LPALUREBUFFERDATAFROMMEMORY)(const ALubyte *fdata, ALsizei length, ALuint buffer);
+typedef ALsizei         (ALURE_APIENTRY *LPALURECREATEBUFFERSFROMFILES)(const ALchar*const*,ALsizei,ALuint*);
+typedef ALsizei         (ALURE_APIENTRY *LPALURECREATEBUFFERSFROMMEMORY)(const ALubyte*const*,const ALsizei*,ALsizei,ALuint*);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMMEMORYKEYED)(const ALchar*,const ALubyte*,ALsizei);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREBUFFERDATAFROMMEMORYKEYED)(const ALchar*,const ALubyte*,ALsizei,ALuint);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETBUFFERCACHESIZE)(alureUInt64);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETDISKCACHEDIRECTORY)(const ALchar*);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMFILEASYNC)(const ALchar*,void(*)(void*,ALuint,ALuint),void*);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMMEMORYASYNC)(const ALubyte*,ALsizei,void(*)(void*,ALuint,ALuint),void*);
+typedef ALboolean       (ALURE_APIENTRY *LPALURECANCELBUFFERLOAD)(ALuint);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREISBUFFERLOADPENDING)(ALuint);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATESHAREDBUFFERFROMFILE)(const ALchar*);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATESHAREDBUFFERFROMMEMORY)(const ALubyte*,ALsizei);
+typedef ALboolean       (ALURE_APIENTRY *LPALURERELEASESHAREDBUFFER)(ALuint);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMFILERANGE)(const ALchar*,alureUInt64,alureUInt64);
+typedef ALuint          (ALURE_APIENTRY *LPALURECREATEBUFFERFROMMEMORYRANGE)(const ALubyte*,ALsizei,alureUInt64,alureUInt64);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETMEMORYBUDGET)(alureUInt64,void(*)(void*,alureUInt64,alureUInt64),void*);
+typedef alureUInt64     (ALURE_APIENTRY *LPALUREGETMEMORYUSAGE)(void);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREREGISTEREVICTABLEBUFFER)(ALuint,const ALchar*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREUNREGISTEREVICTABLEBUFFER)(ALuint);
+typedef ALboolean       (ALURE_APIENTRY *LPALURETOUCHBUFFER)(ALuint);
 typedef ALboolean       (ALURE_APIENTRY *LPALURESTREAMSIZEISMICROSEC)(ALboolean);
 typedef alureStream*    (ALURE_APIENTRY *LPALURECREATESTREAMFROMFILE)(const ALchar*,ALsizei,ALsizei,ALuint*);
 typedef alureStream*    (ALURE_APIENTRY *LPALURECREATESTREAMFROMMEMORY)(const ALubyte*,ALuint,ALsizei,ALsizei,ALuint*);
@@ -136,6 +220,8 @@ typedef ALsizei         (ALURE_APIENTRY *LPALUREBUFFERDATAFROMSTREAM)(alureStrea
 typedef ALboolean       (ALURE_APIENTRY *LPALUREREWINDSTREAM)(alureStream*);
 typedef ALboolean       (ALURE_APIENTRY *LPALURESETSTREAMORDER)(alureStream*,ALuint);
 typedef ALboolean       (ALURE_APIENTRY *LPALURESETSTREAMPATCHSET)(alureStream*,const ALchar*);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETSTREAMOFFSET)(alureStream*,alureUInt64);
+typedef alureInt64      (ALURE_APIENTRY *LPALUREGETSTREAMOFFSET)(alureStream*);
 typedef ALboolean       (ALURE_APIENTRY *LPALUREDESTROYSTREAM)(alureStream*,ALsizei,ALuint*);
 typedef void            (ALURE_APIENTRY *LPALUREUPDATE)(void);
 typedef ALboolean       (ALURE_APIENTRY *LPALUREUPDATEINTERVAL)(ALfloat);
@@ -146,6 +232,23 @@ typedef ALboolean       (ALURE_APIENTRY *LPALUREPAUSESOURCE)(ALuint);
 typedef ALboolean       (ALURE_APIENTRY *LPALURERESUMESOURCE)(ALuint);
 typedef ALboolean       (ALURE_APIENTRY *LPALUREINSTALLDECODECALLBACKS)(ALint,void*(*)(const char*),void*(*)(const ALubyte*,ALuint),ALboolean(*)(void*,ALenum*,ALuint*,ALuint*),ALuint(*)(void*,ALubyte*,ALuint),ALboolean(*)(void*),void(*)(void*));
 typedef ALboolean       (ALURE_APIENTRY *LPALURESETIOCALLBACKS)(void*(*)(const char*,ALuint),void(*)(void*),ALsizei(*)(void*,ALubyte*,ALuint),ALsizei(*)(void*,const ALubyte*,ALuint),alureInt64(*)(void*,alureInt64,int));
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETREADAHEAD)(ALuint);
+typedef alureUInt64     (ALURE_APIENTRY *LPALUREGETBACKENDSEEKCOUNT)(void);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREMOUNTPACK)(const ALchar*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREUNMOUNTPACK)(const ALchar*);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETFILECACHESIZE)(alureUInt64);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREGETSTREAMIOSTATS)(alureStream*,alureIOStats*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREGETIOSTATS)(alureIOStats*);
+typedef ALboolean       (ALURE_APIENTRY *LPALURESETIOLOGCALLBACK)(void (*)(void*,const ALchar*,ALenum,alureInt64,alureInt64),void*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREPROBEFILE)(const ALchar*,alureProbeInfo*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREPROBEMEMORY)(const ALubyte*,ALuint,alureProbeInfo*);
+typedef ALsizei         (ALURE_APIENTRY *LPALUREPROBEFILES)(const ALchar*const*,ALsizei,alureProbeInfo*);
+typedef alureDecoder*   (ALURE_APIENTRY *LPALUREOPENDECODER)(const ALchar*,ALuint,ALuint,alureProbeInfo*);
+typedef alureDecoder*   (ALURE_APIENTRY *LPALUREOPENDECODERFROMMEMORY)(const ALubyte*,ALuint,ALuint,ALuint,alureProbeInfo*);
+typedef ALsizei         (ALURE_APIENTRY *LPALUREREADFRAMES)(alureDecoder*,ALvoid*,ALsizei);
+typedef ALboolean       (ALURE_APIENTRY *LPALURECLOSEDECODER)(alureDecoder*);
+typedef ALboolean       (ALURE_APIENTRY *LPALUREDEFERCALLBACKS)(ALboolean);
+typedef ALsizei         (ALURE_APIENTRY *LPALUREPOLLEVENTS)(void);
 typedef void*           (ALURE_APIENTRY *LPALUREGETPROCADDRESS)(const ALchar*);
 
 #if defined(__cplusplus)
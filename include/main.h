@@ -42,6 +42,9 @@ void DeleteCriticalSection(CRITICAL_SECTION *cs);
 #include <algorithm>
 #include <vector>
 #include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
 
 static const union {
     int val;
@@ -56,9 +59,17 @@ extern PFNALCGETTHREADCONTEXTPROC palcGetThreadContext;
 #define alcSetThreadContext palcSetThreadContext
 #define alcGetThreadContext palcGetThreadContext
 
+struct ThreadInfo;
+ThreadInfo *StartThread(ALuint (*func)(ALvoid*), ALvoid *ptr);
+ALuint StopThread(ThreadInfo *inf);
+ALuint GetProcessorCount(void);
+// Microseconds from an arbitrary point
+alureUInt64 GetTimeUS(void);
+
 void SetError(const char *err);
 ALuint DetectBlockAlignment(ALenum format);
 ALuint DetectCompressionRate(ALenum format);
+ALuint DetectChannels(ALenum format);
 ALenum GetSampleFormat(ALuint channels, ALuint bits, bool isFloat);
 
 struct UserCallbacks {
@@ -72,7 +83,128 @@ struct UserCallbacks {
 extern std::map<ALint,UserCallbacks> InstalledCallbacks;
 
 
+extern CRITICAL_SECTION cs_StreamList;
+
+
+// Base for the library's stream buffers, giving direct access to the data
+// they have buffered
+class SourceBuf : public std::streambuf {
+public:
+    const char *Window(size_t *len)
+    {
+        *len = egptr()-gptr();
+        return gptr();
+    }
+    void Consume(size_t len)
+    {
+        for(;len > INT_MAX;len -= INT_MAX)
+            gbump(INT_MAX);
+        gbump(int(len));
+    }
+};
+
+// Unformatted byte access to a decoder's input. This goes straight to the
+// stream buffer, skipping the istream sentries and state, and copies small
+// reads from the buffered data inline.
+class ByteSource {
+    SourceBuf *buf;
+    bool atEnd;
+
+public:
+    // Reads up to len bytes, returning how many were read
+    size_t Read(void *dst, size_t len)
+    {
+        if(!buf) return 0;
+
+        size_t avail;
+        const char *win = buf->Window(&avail);
+        if(len <= avail)
+        {
+            memcpy(dst, win, len);
+            buf->Consume(len);
+            return len;
+        }
+
+        size_t got = buf->sgetn(static_cast<char*>(dst), len);
+        if(got < len) atEnd = true;
+        return got;
+    }
+
+    // Returns the next byte without reading it, or -1 at the end
+    int Peek()
+    {
+        if(!buf) return -1;
+        std::streambuf::int_type c = buf->sgetc();
+        if(c == std::streambuf::traits_type::eof())
+            return -1;
+        return c&0xFF;
+    }
+
+    // Seeks like fseek, returning the new offset or -1 on failure
+    alureInt64 Seek(alureInt64 offset, int whence)
+    {
+        if(!buf) return -1;
+
+        std::ios_base::seekdir dir;
+        if(whence == SEEK_SET) dir = std::ios_base::beg;
+        else if(whence == SEEK_CUR) dir = std::ios_base::cur;
+        else if(whence == SEEK_END) dir = std::ios_base::end;
+        else return -1;
+
+        std::streampos pos = buf->pubseekoff(offset, dir, std::ios_base::in);
+        if(pos == std::streampos(std::streamoff(-1)))
+            return -1;
+        atEnd = false;
+        return std::streamoff(pos);
+    }
+    bool Skip(alureInt64 offset)
+    { return Seek(offset, SEEK_CUR) >= 0; }
+
+    alureInt64 Tell()
+    {
+        if(!buf) return -1;
+        return std::streamoff(buf->pubseekoff(0, std::ios_base::cur, std::ios_base::in));
+    }
+
+    // Returns the total size of the input, or -1 if it can't be found
+    alureInt64 Size()
+    {
+        alureInt64 pos = Tell();
+        if(pos < 0) return -1;
+        alureInt64 end = Seek(0, SEEK_END);
+        if(Seek(pos, SEEK_SET) < 0)
+            return -1;
+        return end;
+    }
+
+    // True after a read came up short
+    bool Eof() const
+    { return atEnd; }
+
+    // Returns a pointer to the data at the current offset that can be used
+    // without copying, and sets *len to how much there is. The data is
+    // valid until the next operation, and Skip is used to move past it.
+    const ALubyte *GetPtr(size_t *len)
+    {
+        *len = 0;
+        if(!buf || buf->sgetc() == std::streambuf::traits_type::eof())
+            return NULL;
+        return reinterpret_cast<const ALubyte*>(buf->Window(len));
+    }
+
+    explicit ByteSource(std::istream *stream)
+      : buf(stream ? dynamic_cast<SourceBuf*>(stream->rdbuf()) : NULL),
+        atEnd(false)
+    { }
+};
+
+
 void StopStream(alureStream *stream);
+void LockStreamDecode(alureStream *stream);
+void UnlockStreamDecode(alureStream *stream, bool discard);
+void StopDecodePool(void);
+void ClearPlayEvents(void);
+void UpdateStreamMemory(alureInt64 change);
 struct alureStream {
     // Local copy of memory data
     ALubyte *data;
@@ -83,6 +215,12 @@ struct alureStream {
     // Abstracted input stream
     std::istream *fstream;
 
+    // Fast byte access to fstream, for decoders
+    ByteSource src;
+
+    // Bytes counted against the memory budget
+    alureUInt64 memUsage;
+
     virtual bool IsValid() = 0;
     virtual bool GetFormat(ALenum*,ALuint*,ALuint*) = 0;
     virtual ALuint GetData(ALubyte*,ALuint) = 0;
@@ -98,20 +236,73 @@ struct alureStream {
     virtual alureInt64 GetLength()
     { return 0; }
 
+    // Seeks to the given sample frame (or the start of the block containing
+    // it, for block-compressed formats). The default rewinds and decodes up to
+    // it.
+    virtual bool Seek(alureUInt64 frame);
+    // Returns the sample frame the next decoded data starts at, or -1 if it
+    // isn't known
+    virtual alureInt64 Tell()
+    {
+        SetError("Stream position unknown");
+        return -1;
+    }
+
+    // Returns a pointer to up to *bytes of the remaining data, if it can be
+    // used as-is without decoding (eg. uncompressed samples held in memory).
+    // The stream is advanced past the data, and *bytes is set to its size.
+    // Returns NULL without advancing otherwise.
+    virtual const ALubyte *GetDataPtr(ALuint*)
+    { return NULL; }
+
+    // Gets the next chunk of data, pointing straight at the stream's data
+    // when possible and decoding into dataChunk otherwise
+    ALuint GetChunk(const ALubyte **ptr)
+    {
+        ALuint got = dataChunk.size();
+        *ptr = GetDataPtr(&got);
+        if(*ptr) return got;
+
+        *ptr = &dataChunk[0];
+        return GetData(&dataChunk[0], dataChunk.size());
+    }
+
+    void AddMemoryUsage(alureUInt64 bytes)
+    {
+        memUsage += bytes;
+        UpdateStreamMemory(bytes);
+    }
+
     alureStream(std::istream *_stream)
-      : data(NULL), fstream(_stream)
-    { StreamList.push_front(this); }
+      : data(NULL), fstream(_stream), src(_stream), memUsage(0)
+    {
+        EnterCriticalSection(&cs_StreamList);
+        StreamList.push_front(this);
+        LeaveCriticalSection(&cs_StreamList);
+    }
     virtual ~alureStream()
     {
         delete[] data;
+        if(memUsage > 0)
+            UpdateStreamMemory(-alureInt64(memUsage));
+        EnterCriticalSection(&cs_StreamList);
         StreamList.erase(std::find(StreamList.begin(), StreamList.end(), this));
+        LeaveCriticalSection(&cs_StreamList);
     }
 
     static void Clear(void)
     {
-        while(StreamList.size() > 0)
+        while(1)
         {
+            EnterCriticalSection(&cs_StreamList);
+            if(StreamList.size() == 0)
+            {
+                LeaveCriticalSection(&cs_StreamList);
+                break;
+            }
             alureStream *stream = *(StreamList.begin());
+            LeaveCriticalSection(&cs_StreamList);
+
             StopStream(stream);
             std::istream *f = stream->fstream;
             delete stream;
@@ -121,8 +312,11 @@ struct alureStream {
 
     static bool Verify(alureStream *stream)
     {
+        EnterCriticalSection(&cs_StreamList);
         ListType::iterator i = std::find(StreamList.begin(), StreamList.end(), stream);
-        return (i != StreamList.end());
+        bool found = (i != StreamList.end());
+        LeaveCriticalSection(&cs_StreamList);
+        return found;
     }
 
 private:
@@ -157,6 +351,38 @@ struct MemDataInfo {
     { }
 };
 
+struct PackFile;
+
+// A read-only view of a whole file mapped into memory, or of an entry in a
+// mounted pack file
+struct FileMapping {
+    const ALubyte *Data;
+    size_t Length;
+    PackFile *Pack;
+#ifdef HAVE_WINDOWS_H
+    HANDLE File;
+    HANDLE Mapping;
+#endif
+
+    FileMapping() : Data(NULL), Length(0), Pack(NULL)
+    { }
+};
+// Maps the named file, looking in mounted packs first. Local files are only
+// mapped when using the default I/O routines.
+bool MapFile(const char *filename, FileMapping *mapping);
+void UnmapFile(FileMapping *mapping);
+// Maps a file from the local file system, regardless of the I/O routines
+bool MapLocalFile(const char *filename, FileMapping *mapping);
+void UnmapLocalFile(FileMapping *mapping);
+// Finds the named entry in the mounted packs, and holds the pack until the
+// view is unmapped
+bool MapPackEntry(const char *name, FileMapping *mapping);
+void UnmapPackEntry(FileMapping *mapping);
+// Builds a buffer cache key for a mapped pack entry, from the pack's mount and
+// the entry's place in it
+std::string GetPackEntryKey(const FileMapping *mapping);
+void UnmountPacks(void);
+
 class InStream : public std::istream {
 public:
     InStream(const char *filename);
@@ -164,39 +390,80 @@ public:
     virtual ~InStream();
 };
 
+// Returns the memory backing the given stream, if it reads from memory, and
+// NULL otherwise
+const ALubyte *GetStreamMemory(std::istream *stream, alureUInt64 *length);
+// Moves the file mapping backing the given stream to the caller, so memory
+// from GetStreamMemory stays valid after the stream is gone. Returns false if
+// the stream isn't reading a mapped file.
+bool TakeStreamMapping(std::istream *stream, FileMapping *mapping);
+// Gets the backend I/O done by the given stream. Returns false if it isn't
+// reading through the I/O callbacks.
+bool GetStreamIOStats(std::istream *stream, alureIOStats *stats);
+// Lets the stream drop the file header it keeps while decoders are probed
+void EndStreamProbe(std::istream *stream);
+void StopReadAhead(void);
+void ClearFileCache(void);
+
+
+// 64-bit FNV-1a hash, which can be continued over multiple blocks of data by
+// passing the previous result back in
+static inline alureUInt64 HashBytes(const ALubyte *data, size_t len,
+                                    alureUInt64 hash=14695981039346656037ull)
+{
+    for(size_t i = 0;i < len;i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
-static inline ALuint read_le32(std::istream *file)
+// A second 64-bit hash, unrelated to HashBytes, for checking data that
+// matched by HashBytes is really the same. It's continued the same way.
+static inline alureUInt64 CheckBytes(const ALubyte *data, size_t len,
+                                     alureUInt64 hash=11400714819323198485ull)
+{
+    for(size_t i = 0;i < len;i++)
+    {
+        hash = (hash + data[i] + 1) * 18397679294719823053ull;
+        hash ^= hash >> 33;
+    }
+    return hash;
+}
+
+static inline ALuint read_le32(ByteSource &src)
 {
     ALubyte buffer[4];
-    if(!file->read(reinterpret_cast<char*>(buffer), 4)) return 0;
+    if(src.Read(buffer, 4) != 4) return 0;
     return buffer[0] | (buffer[1]<<8) | (buffer[2]<<16) | (buffer[3]<<24);
 }
 
-static inline ALushort read_le16(std::istream *file)
+static inline ALushort read_le16(ByteSource &src)
 {
     ALubyte buffer[2];
-    if(!file->read(reinterpret_cast<char*>(buffer), 2)) return 0;
+    if(src.Read(buffer, 2) != 2) return 0;
     return buffer[0] | (buffer[1]<<8);
 }
 
-static inline ALuint read_be32(std::istream *file)
+static inline ALuint read_be32(ByteSource &src)
 {
     ALubyte buffer[4];
-    if(!file->read(reinterpret_cast<char*>(buffer), 4)) return 0;
+    if(src.Read(buffer, 4) != 4) return 0;
     return (buffer[0]<<24) | (buffer[1]<<16) | (buffer[2]<<8) | buffer[3];
 }
 
-static inline ALushort read_be16(std::istream *file)
+static inline ALushort read_be16(ByteSource &src)
 {
     ALubyte buffer[2];
-    if(!file->read(reinterpret_cast<char*>(buffer), 2)) return 0;
+    if(src.Read(buffer, 2) != 2) return 0;
     return (buffer[0]<<8) | buffer[1];
 }
 
-static inline ALuint read_be80extended(std::istream *file)
+static inline ALuint read_be80extended(ByteSource &src)
 {
     ALubyte buffer[10];
-    if(!file->read(reinterpret_cast<char*>(buffer), 10)) return 0;
+    if(src.Read(buffer, 10) != 10) return 0;
     ALuint mantissa, last = 0;
     ALubyte exp = buffer[1];
     exp = 30 - exp;
@@ -212,6 +479,18 @@ static inline ALuint read_be80extended(std::istream *file)
 
 
 extern CRITICAL_SECTION cs_StreamPlay;
+extern CRITICAL_SECTION cs_BufferCache;
+extern CRITICAL_SECTION cs_BufferLoad;
+extern CRITICAL_SECTION cs_IOStats;
+extern CRITICAL_SECTION cs_ReadAhead;
+extern CRITICAL_SECTION cs_PackList;
+extern CRITICAL_SECTION cs_FileCache;
+extern CRITICAL_SECTION cs_DecodePool;
+extern CRITICAL_SECTION cs_PlayEvents;
+
+void UpdateBufferLoads(void);
+void StopBufferLoads(void);
+void MarkBufferUsed(ALuint buffer);
 
 alureStream *create_stream(const char *fname);
 alureStream *create_stream(const MemDataInfo &memData);
@@ -231,9 +510,29 @@ void swap(T &val1, T &val2)
 
 
 struct Decoder {
+    // How well a decoder's signature matches a file's header. NoMatch rules
+    // the decoder out, MaybeMatch is for formats that can't be identified by
+    // the header alone.
+    enum ProbeResult {
+        NoMatch,
+        MaybeMatch,
+        Match
+    };
+    // Size of the file header given to the probes
+    static const size_t ProbeSize = 64;
+
     typedef std::auto_ptr<alureStream>(*FactoryType)(std::istream*);
-    typedef std::multimap<ALint,FactoryType> ListType;
-    typedef std::pair<ALint,FactoryType> PairType;
+    typedef ProbeResult(*ProbeType)(const ALubyte*,size_t);
+
+    struct Entry {
+        FactoryType Factory;
+        ProbeType Probe;
+        // Comma-separated list of file extensions, used to order decoders
+        // that can't be told apart by their header
+        const char *Extensions;
+    };
+    typedef std::multimap<ALint,Entry> ListType;
+    typedef std::pair<ALint,Entry> PairType;
 
     struct FindSecond {
         FactoryType mFactory;
@@ -241,13 +540,14 @@ struct Decoder {
         { }
 
         bool operator()(const PairType &entry) const
-        { return mFactory == entry.second; }
+        { return mFactory == entry.second.Factory; }
     };
 
     static const ListType& GetList();
 
 protected:
-    static ListType& AddList(FactoryType func=NULL, ALint prio=0);
+    static ListType& AddList(FactoryType func=NULL, ProbeType probe=NULL,
+                             const char *exts=NULL, ALint prio=0);
 };
 
 template<typename T, ALint prio>
@@ -255,7 +555,7 @@ struct DecoderDecl : public Decoder {
     DecoderDecl()
     {
         T::Init();
-        AddList(Factory, prio);
+        AddList(Factory, T::Probe, T::Extensions(), prio);
     }
     ~DecoderDecl()
     {
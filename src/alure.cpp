@@ -34,6 +34,12 @@
 #ifdef HAVE_WINDOWS_H
 #include <windows.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifndef HAVE_WINDOWS_H
+#include <sys/time.h>
+#endif
 
 #include <vector>
 #include <string>
@@ -41,6 +47,15 @@
 
 std::map<ALint,UserCallbacks> InstalledCallbacks;
 CRITICAL_SECTION cs_StreamPlay;
+CRITICAL_SECTION cs_StreamList;
+CRITICAL_SECTION cs_BufferCache;
+CRITICAL_SECTION cs_BufferLoad;
+CRITICAL_SECTION cs_IOStats;
+CRITICAL_SECTION cs_ReadAhead;
+CRITICAL_SECTION cs_PackList;
+CRITICAL_SECTION cs_FileCache;
+CRITICAL_SECTION cs_DecodePool;
+CRITICAL_SECTION cs_PlayEvents;
 alureStream::ListType alureStream::StreamList;
 
 PFNALCSETTHREADCONTEXTPROC palcSetThreadContext;
@@ -52,20 +67,19 @@ static inline void LoadALCProc(ALCdevice *dev, const char *name, T **ptr)
 { *ptr = reinterpret_cast<T*>(alcGetProcAddress(dev, name)); }
 
 
+// deinit_alure cleans up streams, so it's called while the stream list is
+// still around. The list is defined before MyConstructor, so it's destroyed
+// after it.
 #ifdef HAVE_GCC_CONSTRUCTOR
 static void init_alure(void) __attribute__((constructor));
-static void deinit_alure(void) __attribute__((destructor));
+static void deinit_alure(void);
 static struct MyConstructorClass {
     ~MyConstructorClass()
-    { alureStream::Clear(); };
+    { deinit_alure(); };
 } MyConstructor;
 #elif defined(_WIN32) && !defined(ALURE_STATIC_LIBRARY)
 static void init_alure(void);
 static void deinit_alure(void);
-static struct MyConstructorClass {
-    ~MyConstructorClass()
-    { alureStream::Clear(); };
-} MyConstructor;
 
 extern "C" BOOL APIENTRY DllMain(HINSTANCE module, DWORD reason, LPVOID /*reserved*/)
 {
@@ -91,14 +105,22 @@ static struct MyConstructorClass {
     MyConstructorClass()
     { init_alure(); };
     ~MyConstructorClass()
-    { alureStream::Clear();
-      deinit_alure(); };
+    { deinit_alure(); };
 } MyConstructor;
 #endif
 
 static void init_alure(void)
 {
     InitializeCriticalSection(&cs_StreamPlay);
+    InitializeCriticalSection(&cs_StreamList);
+    InitializeCriticalSection(&cs_BufferCache);
+    InitializeCriticalSection(&cs_BufferLoad);
+    InitializeCriticalSection(&cs_IOStats);
+    InitializeCriticalSection(&cs_ReadAhead);
+    InitializeCriticalSection(&cs_PackList);
+    InitializeCriticalSection(&cs_FileCache);
+    InitializeCriticalSection(&cs_DecodePool);
+    InitializeCriticalSection(&cs_PlayEvents);
 
     if(alcIsExtensionPresent(NULL, "ALC_EXT_thread_local_context"))
     {
@@ -116,9 +138,28 @@ static void init_alure(void)
     }
 }
 
+// Async loads are stopped before the streams are deleted, since the loader may
+// be decoding one, and everything is cleaned up before the locks go away
 static void deinit_alure(void)
 {
     alureUpdateInterval(0.0f);
+    StopBufferLoads();
+    alureSetBufferCacheSize(0);
+    alureStream::Clear();
+    StopDecodePool();
+    StopReadAhead();
+    UnmountPacks();
+    ClearFileCache();
+    ClearPlayEvents();
+    DeleteCriticalSection(&cs_PlayEvents);
+    DeleteCriticalSection(&cs_DecodePool);
+    DeleteCriticalSection(&cs_FileCache);
+    DeleteCriticalSection(&cs_PackList);
+    DeleteCriticalSection(&cs_ReadAhead);
+    DeleteCriticalSection(&cs_IOStats);
+    DeleteCriticalSection(&cs_BufferLoad);
+    DeleteCriticalSection(&cs_BufferCache);
+    DeleteCriticalSection(&cs_StreamList);
     DeleteCriticalSection(&cs_StreamPlay);
 }
 
@@ -166,6 +207,128 @@ void DeleteCriticalSection(CRITICAL_SECTION *cs)
 #endif
 
 
+#ifdef HAVE_WINDOWS_H
+
+struct ThreadInfo {
+    ALuint (*func)(ALvoid*);
+    ALvoid *ptr;
+    HANDLE thread;
+};
+
+static DWORD CALLBACK StarterFunc(void *ptr)
+{
+    ThreadInfo *inf = (ThreadInfo*)ptr;
+    ALint ret;
+
+    ret = inf->func(inf->ptr);
+    ExitThread((DWORD)ret);
+
+    return (DWORD)ret;
+}
+
+ThreadInfo *StartThread(ALuint (*func)(ALvoid*), ALvoid *ptr)
+{
+    DWORD dummy;
+    ThreadInfo *inf = new ThreadInfo;
+    inf->func = func;
+    inf->ptr = ptr;
+
+    inf->thread = CreateThread(NULL, 0, StarterFunc, inf, 0, &dummy);
+    if(!inf->thread)
+    {
+        delete inf;
+        return NULL;
+    }
+
+    return inf;
+}
+
+ALuint StopThread(ThreadInfo *inf)
+{
+    WaitForSingleObject(inf->thread, INFINITE);
+    CloseHandle(inf->thread);
+    delete inf;
+
+    return 0;
+}
+
+ALuint GetProcessorCount(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return std::max<ALuint>(info.dwNumberOfProcessors, 1);
+}
+
+#else
+
+struct ThreadInfo {
+    ALuint (*func)(ALvoid*);
+    ALvoid *ptr;
+    pthread_t thread;
+};
+
+static void *StarterFunc(void *ptr)
+{
+    ThreadInfo *inf = (ThreadInfo*)ptr;
+    void *ret = (void*)(inf->func(inf->ptr));
+    return ret;
+}
+
+ThreadInfo *StartThread(ALuint (*func)(ALvoid*), ALvoid *ptr)
+{
+    ThreadInfo *inf = new ThreadInfo;
+    inf->func = func;
+    inf->ptr = ptr;
+
+    if(pthread_create(&inf->thread, NULL, StarterFunc, inf) != 0)
+    {
+        delete inf;
+        return NULL;
+    }
+
+    return inf;
+}
+
+ALuint StopThread(ThreadInfo *inf)
+{
+    pthread_join(inf->thread, NULL);
+    delete inf;
+
+    return 0;
+}
+
+ALuint GetProcessorCount(void)
+{
+#ifdef HAVE_SYSCONF
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if(count > 0)
+        return count;
+#endif
+    return 1;
+}
+
+#endif
+
+alureUInt64 GetTimeUS(void)
+{
+#ifdef HAVE_WINDOWS_H
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return alureUInt64(count.QuadPart / freq.QuadPart) * 1000000 +
+           alureUInt64(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#elif defined(HAVE_CLOCK_GETTIME)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return alureUInt64(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return alureUInt64(tv.tv_sec)*1000000 + tv.tv_usec;
+#endif
+}
+
+
 static const ALchar *last_error = "No error";
 void SetError(const char *err)
 {
@@ -268,8 +431,106 @@ ALuint DetectCompressionRate(ALenum format)
     return 0;
 }
 
+ALuint DetectChannels(ALenum format)
+{
+    switch(format)
+    {
+    case AL_FORMAT_MONO8:
+    case AL_FORMAT_MONO16:
+    case AL_FORMAT_MONO_FLOAT32:
+    case AL_FORMAT_MONO_DOUBLE_EXT:
+    case AL_FORMAT_MONO_MULAW:
+    case AL_FORMAT_MONO_IMA4:
+        return 1;
+
+    case AL_FORMAT_STEREO8:
+    case AL_FORMAT_STEREO16:
+    case AL_FORMAT_STEREO_FLOAT32:
+    case AL_FORMAT_STEREO_DOUBLE_EXT:
+    case AL_FORMAT_STEREO_MULAW:
+    case AL_FORMAT_STEREO_IMA4:
+    case AL_FORMAT_REAR8:
+    case AL_FORMAT_REAR16:
+    case AL_FORMAT_REAR32:
+    case AL_FORMAT_REAR_MULAW:
+        return 2;
+
+    case AL_FORMAT_QUAD8:
+    case AL_FORMAT_QUAD16:
+    case AL_FORMAT_QUAD32:
+    case AL_FORMAT_QUAD_MULAW:
+    case AL_FORMAT_QUAD8_LOKI:
+    case AL_FORMAT_QUAD16_LOKI:
+        return 4;
+
+    case AL_FORMAT_51CHN8:
+    case AL_FORMAT_51CHN16:
+    case AL_FORMAT_51CHN32:
+    case AL_FORMAT_51CHN_MULAW:
+        return 6;
+
+    case AL_FORMAT_61CHN8:
+    case AL_FORMAT_61CHN16:
+    case AL_FORMAT_61CHN32:
+    case AL_FORMAT_61CHN_MULAW:
+        return 7;
+
+    case AL_FORMAT_71CHN8:
+    case AL_FORMAT_71CHN16:
+    case AL_FORMAT_71CHN32:
+    case AL_FORMAT_71CHN_MULAW:
+        return 8;
+    }
+    return 0;
+}
+
+// Without a context there's nothing to check format support against, so the
+// standard values are given. This lets files be described (see
+// alureProbeFile) without one; nothing can be played without one anyway.
+static ALenum GetStandardFormat(ALuint channels, ALuint bits, bool isFloat)
+{
+    static const struct {
+        ALuint channels;
+        ALuint bits;
+        bool isFloat;
+        ALenum format;
+    } formats[] = {
+        { 1,  8, false, AL_FORMAT_MONO8 },
+        { 2,  8, false, AL_FORMAT_STEREO8 },
+        { 4,  8, false, AL_FORMAT_QUAD8 },
+        { 6,  8, false, AL_FORMAT_51CHN8 },
+        { 7,  8, false, AL_FORMAT_61CHN8 },
+        { 8,  8, false, AL_FORMAT_71CHN8 },
+        { 1, 16, false, AL_FORMAT_MONO16 },
+        { 2, 16, false, AL_FORMAT_STEREO16 },
+        { 4, 16, false, AL_FORMAT_QUAD16 },
+        { 6, 16, false, AL_FORMAT_51CHN16 },
+        { 7, 16, false, AL_FORMAT_61CHN16 },
+        { 8, 16, false, AL_FORMAT_71CHN16 },
+        { 1, 32, true,  AL_FORMAT_MONO_FLOAT32 },
+        { 2, 32, true,  AL_FORMAT_STEREO_FLOAT32 },
+        { 4, 32, true,  AL_FORMAT_QUAD32 },
+        { 6, 32, true,  AL_FORMAT_51CHN32 },
+        { 7, 32, true,  AL_FORMAT_61CHN32 },
+        { 8, 32, true,  AL_FORMAT_71CHN32 },
+        { 1, 64, true,  AL_FORMAT_MONO_DOUBLE_EXT },
+        { 2, 64, true,  AL_FORMAT_STEREO_DOUBLE_EXT },
+    };
+    for(size_t i = 0;i < sizeof(formats)/sizeof(formats[0]);i++)
+    {
+        if(formats[i].channels == channels && formats[i].bits == bits &&
+           formats[i].isFloat == isFloat)
+            return formats[i].format;
+    }
+    SetError("Unsupported sample format\n");
+    return AL_NONE;
+}
+
 ALenum GetSampleFormat(ALuint channels, ALuint bits, bool isFloat)
 {
+    if(!alcGetCurrentContext())
+        return GetStandardFormat(channels, bits, isFloat);
+
 #define CHECK_FMT_RET(f) do {                                                 \
     ALenum fmt = alGetEnumValue(#f);                                          \
     if(alGetError() == AL_NO_ERROR && fmt != 0 && fmt != -1)                  \
@@ -703,6 +964,45 @@ ALURE_API void* ALURE_APIENTRY alureGetProcAddress(const ALchar *funcname)
         ADD_FUNCTION(alureCreateBufferFromMemory)
         ADD_FUNCTION(alureBufferDataFromFile)
         ADD_FUNCTION(alureBufferDataFromMemory)
+        ADD_FUNCTION(alureCreateBuffersFromFiles)
+        ADD_FUNCTION(alureCreateBuffersFromMemory)
+        ADD_FUNCTION(alureCreateBufferFromMemoryKeyed)
+        ADD_FUNCTION(alureBufferDataFromMemoryKeyed)
+        ADD_FUNCTION(alureSetBufferCacheSize)
+        ADD_FUNCTION(alureSetDiskCacheDirectory)
+        ADD_FUNCTION(alureCreateBufferFromFileAsync)
+        ADD_FUNCTION(alureCreateBufferFromMemoryAsync)
+        ADD_FUNCTION(alureCancelBufferLoad)
+        ADD_FUNCTION(alureIsBufferLoadPending)
+        ADD_FUNCTION(alureCreateSharedBufferFromFile)
+        ADD_FUNCTION(alureCreateSharedBufferFromMemory)
+        ADD_FUNCTION(alureReleaseSharedBuffer)
+        ADD_FUNCTION(alureCreateBufferFromFileRange)
+        ADD_FUNCTION(alureCreateBufferFromMemoryRange)
+        ADD_FUNCTION(alureSetMemoryBudget)
+        ADD_FUNCTION(alureGetMemoryUsage)
+        ADD_FUNCTION(alureRegisterEvictableBuffer)
+        ADD_FUNCTION(alureUnregisterEvictableBuffer)
+        ADD_FUNCTION(alureTouchBuffer)
+        ADD_FUNCTION(alureSetStreamOffset)
+        ADD_FUNCTION(alureGetStreamOffset)
+        ADD_FUNCTION(alureGetBackendSeekCount)
+        ADD_FUNCTION(alureSetReadAhead)
+        ADD_FUNCTION(alureMountPack)
+        ADD_FUNCTION(alureUnmountPack)
+        ADD_FUNCTION(alureSetFileCacheSize)
+        ADD_FUNCTION(alureGetStreamIOStats)
+        ADD_FUNCTION(alureGetIOStats)
+        ADD_FUNCTION(alureSetIOLogCallback)
+        ADD_FUNCTION(alureProbeFile)
+        ADD_FUNCTION(alureProbeMemory)
+        ADD_FUNCTION(alureProbeFiles)
+        ADD_FUNCTION(alureOpenDecoder)
+        ADD_FUNCTION(alureOpenDecoderFromMemory)
+        ADD_FUNCTION(alureReadFrames)
+        ADD_FUNCTION(alureCloseDecoder)
+        ADD_FUNCTION(alureDeferCallbacks)
+        ADD_FUNCTION(alurePollEvents)
         ADD_FUNCTION(alureCreateStreamFromFile)
         ADD_FUNCTION(alureCreateStreamFromMemory)
         ADD_FUNCTION(alureCreateStreamFromStaticMemory)
@@ -27,81 +27,1762 @@
 
 #include "main.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <list>
+#include <map>
+#include <sstream>
 
 
-static bool load_stream(alureStream *_stream, ALuint buffer)
+// A fully decoded sound, ready to be given to alBufferData. The data is
+// either allocated with malloc (when owned), or points into the mapping or
+// the caller's memory. Decoded data may be held by the buffer cache and any
+// number of loads at once, so it is reference counted (protected by
+// cs_BufferCache).
+struct DecodedData {
+    ALenum format;
+    ALuint freq;
+    ALubyte *data;
+    ALuint size;
+    bool owned;
+    FileMapping mapping;
+
+    ALuint refs;
+    std::string key;
+
+    DecodedData() : format(AL_NONE), freq(0), data(NULL), size(0), owned(true),
+                    refs(1)
+    { }
+    ~DecodedData()
+    {
+        if(owned)
+            free(data);
+        UnmapFile(&mapping);
+    }
+};
+
+typedef std::list<DecodedData*> BufferCacheList;
+typedef std::map<std::string,BufferCacheList::iterator> BufferCacheMap;
+// Most recently used entries are at the front. These are never deleted, since
+// deinit_alure empties them after static objects may have been destroyed.
+static BufferCacheList &BufferCache = *new BufferCacheList;
+static BufferCacheMap &BufferCacheIndex = *new BufferCacheMap;
+static alureUInt64 BufferCacheUsed = 0;
+static alureUInt64 BufferCacheMax = 0;
+// Protected by cs_BufferCache. Empty when the disk cache is disabled.
+static std::string DiskCacheDir;
+
+// The header at the start of each disk cache file. The decoded samples
+// follow it directly. The file is only valid for a source with the same
+// size, modification time, and content hash.
+struct DiskCacheHeader {
+    char magic[8];
+    ALuint version;
+    ALenum format;
+    ALuint freq;
+    ALuint size;
+    alureUInt64 srcSize;
+    alureInt64 srcTime;
+    alureUInt64 srcHash;
+};
+static const char DiskCacheMagic[8] = { 'A','L','U','R','E','P','C','M' };
+static const ALuint DiskCacheVersion = 1;
+
+// Decodes the stream into the given storage. When a range is given, only the
+// sample frames in [start, end) are decoded (rounded out to whole blocks for
+// block-compressed formats), seeking to the start first.
+static bool decode_stream(alureStream *_stream, DecodedData *decoded,
+                          alureUInt64 start=0, alureUInt64 end=0)
+{
+    if(!_stream)
+        return false;
+
+    std::auto_ptr<std::istream> fstream(_stream->fstream);
+    std::auto_ptr<alureStream> stream(_stream);
+
+    ALenum format;
+    ALuint freq, blockAlign;
+
+    if(!stream->GetFormat(&format, &freq, &blockAlign))
+    {
+        SetError("Could not get sample format");
+        return false;
+    }
+
+    if(format == AL_NONE)
+    {
+        SetError("No valid format");
+        return false;
+    }
+    if(blockAlign == 0)
+    {
+        SetError("Invalid block size");
+        return false;
+    }
+    if(freq == 0)
+    {
+        SetError("Invalid sample rate");
+        return false;
+    }
+
+    const ALuint maxSize = 0x7FFFFFFF - (0x7FFFFFFF%blockAlign);
+    ALuint limit = maxSize;
+    alureInt64 length = stream->GetLength();
+
+    const bool ranged = (end > start);
+    if(ranged)
+    {
+        ALuint framesPerBlock = DetectCompressionRate(format);
+        if(framesPerBlock == 0 || DetectBlockAlignment(format) == 0)
+        {
+            SetError("Unknown compression rate");
+            return false;
+        }
+
+        start -= start%framesPerBlock;
+        alureUInt64 blocks = (end-start+framesPerBlock-1) / framesPerBlock;
+        if(blocks > maxSize/blockAlign)
+        {
+            SetError("Sound too large");
+            return false;
+        }
+        limit = blocks * blockAlign;
+
+        if(start > 0 && !stream->Seek(start))
+            return false;
+        if(length > 0)
+            length = std::max<alureInt64>(length-alureInt64(start), 0);
+    }
+
+    // Samples that can be used as-is from memory don't need a copy
+    ALuint directSize = limit;
+    const ALubyte *direct = stream->GetDataPtr(&directSize);
+    if(direct)
+    {
+        ALuint more = blockAlign;
+        if(!ranged && stream->GetDataPtr(&more) && more > 0)
+        {
+            SetError("Sound too large");
+            return false;
+        }
+
+        decoded->format = format;
+        decoded->freq = freq;
+        decoded->data = const_cast<ALubyte*>(direct);
+        decoded->size = directSize;
+        decoded->owned = false;
+        // Keep the file mapping the samples are in, if the stream has one
+        TakeStreamMapping(stream->fstream, &decoded->mapping);
+        return true;
+    }
+
+    // Size the storage for the whole sound (or range) up front when the
+    // decoder knows its length, so it can be decoded in one pass with large
+    // reads. Otherwise start with a second's worth and grow geometrically. The
+    // storage is not zero-filled, and realloc can often grow it in place.
+    size_t dataSize = std::min<size_t>(size_t(freq)*blockAlign, limit);
+    if(length > 0 && DetectBlockAlignment(format) != 0)
+    {
+        alureUInt64 frameBlock = DetectCompressionRate(format);
+        alureUInt64 blocks = (length+frameBlock-1) / frameBlock;
+        if(blocks <= limit/blockAlign)
+            dataSize = std::max<size_t>(blocks*blockAlign, blockAlign);
+        else if(ranged)
+            dataSize = limit;
+    }
+
+    ALubyte *data = static_cast<ALubyte*>(malloc(dataSize));
+    if(!data)
+    {
+        SetError("Out of memory");
+        return false;
+    }
+
+    size_t writePos = 0;
+    ALuint got;
+    std::vector<ALubyte> overflow;
+    while(!ranged || writePos < limit)
+    {
+        size_t avail = std::min<size_t>(dataSize, limit) - writePos;
+        avail -= avail%blockAlign;
+        if(avail > 0)
+        {
+            got = stream->GetData(data+writePos, avail);
+            if(got == 0) break;
+            writePos += got;
+            continue;
+        }
+
+        // Storage is full. Check for more data with a small read before
+        // growing, so a correctly sized buffer isn't doubled just to find
+        // the end of the stream.
+        if(overflow.empty())
+            overflow.resize(std::max<size_t>(4096/blockAlign, 1) * blockAlign);
+        size_t probe = overflow.size();
+        if(ranged) probe = std::min<size_t>(probe, limit-writePos);
+        got = stream->GetData(&overflow[0], probe);
+        if(got == 0) break;
+
+        if(writePos+got > maxSize)
+        {
+            free(data);
+            SetError("Sound too large");
+            return false;
+        }
+        size_t newSize = std::max<size_t>(std::min<size_t>(dataSize*2, limit),
+                                          writePos+got);
+        ALubyte *newData = static_cast<ALubyte*>(realloc(data, newSize));
+        if(!newData)
+        {
+            free(data);
+            SetError("Out of memory");
+            return false;
+        }
+        data = newData;
+        dataSize = newSize;
+
+        memcpy(data+writePos, &overflow[0], got);
+        writePos += got;
+    }
+    writePos -= writePos%blockAlign;
+
+    decoded->format = format;
+    decoded->freq = freq;
+    decoded->data = data;
+    decoded->size = writePos;
+    return true;
+}
+
+static bool upload_data(const DecodedData &decoded, ALuint buffer)
+{
+    alBufferData(buffer, decoded.format, decoded.data, decoded.size, decoded.freq);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer load failed");
+        return false;
+    }
+    return true;
+}
+
+static void release_decoded(DecodedData *decoded)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    bool last = (--decoded->refs == 0);
+    LeaveCriticalSection(&cs_BufferCache);
+    if(last) delete decoded;
+}
+
+// Drops least recently used entries until the cache fits within the given
+// size. Must be called with cs_BufferCache held.
+static void trim_cache(alureUInt64 maxSize)
+{
+    while(BufferCacheUsed > maxSize)
+    {
+        DecodedData *decoded = BufferCache.back();
+        BufferCache.pop_back();
+        BufferCacheIndex.erase(decoded->key);
+        BufferCacheUsed -= decoded->size;
+        if(--decoded->refs == 0)
+            delete decoded;
+    }
+}
+
+
+// The memory budget, covering the buffer cache, streams, shared buffers, and
+// evictable buffers. Protected by cs_BufferCache.
+static alureUInt64 MemoryBudget = 0;
+static void (*MemoryPressureCallback)(void*,alureUInt64,alureUInt64);
+static void *MemoryPressureUserdata;
+static alureUInt64 StreamMemoryUsed = 0;
+static alureUInt64 SharedBufferMemoryUsed = 0;
+
+// Buffers the application registered as evictable, along with the file to
+// reload them from. Most recently used entries are at the front.
+struct EvictableBuffer {
+    ALuint buffer;
+    ALCdevice *device;
+    std::string fname;
+    ALuint size;
+    bool loaded;
+};
+typedef std::list<EvictableBuffer> EvictableList;
+static EvictableList EvictableBuffers;
+static std::map<std::pair<ALCdevice*,ALuint>,EvictableList::iterator> EvictableIndex;
+static alureUInt64 EvictableMemoryUsed = 0;
+
+static alureUInt64 get_memory_used()
+{
+    return BufferCacheUsed + StreamMemoryUsed + SharedBufferMemoryUsed +
+           EvictableMemoryUsed;
+}
+
+static ALCdevice *get_current_device()
+{
+    ALCcontext *ctx = alcGetCurrentContext();
+    return (ctx ? alcGetContextsDevice(ctx) : NULL);
+}
+
+// Finds the evictable buffer entry for the given buffer on the current
+// device. Must be called with cs_BufferCache held.
+static EvictableList::iterator find_evictable(ALuint buffer)
+{
+    std::map<std::pair<ALCdevice*,ALuint>,EvictableList::iterator>::iterator i;
+    i = EvictableIndex.find(std::make_pair(get_current_device(), buffer));
+    if(i == EvictableIndex.end())
+        return EvictableBuffers.end();
+    return i->second;
+}
+
+// Replaces an evictable buffer's data with nothing, and updates its entry if
+// it's still registered and loaded. This fails if the buffer is attached to a
+// source. Must be called without cs_BufferCache held, and with no AL error
+// pending.
+static bool evict_buffer(ALCdevice *device, ALuint buffer)
+{
+    static const ALubyte silence[1] = { 0x80 };
+
+    alBufferData(buffer, AL_FORMAT_MONO8, silence, 0, 44100);
+    if(alGetError() != AL_NO_ERROR)
+        return false;
+
+    EnterCriticalSection(&cs_BufferCache);
+    std::map<std::pair<ALCdevice*,ALuint>,EvictableList::iterator>::iterator i;
+    i = EvictableIndex.find(std::make_pair(device, buffer));
+    if(i != EvictableIndex.end() && i->second->loaded)
+    {
+        EvictableMemoryUsed -= i->second->size;
+        i->second->size = 0;
+        i->second->loaded = false;
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+    return true;
+}
+
+// Brings memory use back within the budget, dropping cached data first and
+// then evicting the least recently used evictable buffers on the current
+// device (except the given one). The pressure callback is called if that
+// isn't enough. This makes AL calls, so it's only called from threads that
+// may use the context, and eviction is skipped if an AL error is pending.
+static void enforce_budget(ALuint keep=0)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    alureUInt64 budget = MemoryBudget;
+    if(budget == 0 || get_memory_used() <= budget)
+    {
+        LeaveCriticalSection(&cs_BufferCache);
+        return;
+    }
+
+    alureUInt64 excess = get_memory_used() - budget;
+    trim_cache((BufferCacheUsed > excess) ? (BufferCacheUsed-excess) : 0);
+
+    // Pick the victims while the list is locked, but evict them after
+    // releasing it
+    ALCdevice *device = get_current_device();
+    std::vector<ALuint> victims;
+    alureUInt64 used = get_memory_used();
+    EvictableList::iterator i = EvictableBuffers.end();
+    while(used > budget && i != EvictableBuffers.begin())
+    {
+        --i;
+        if(i->loaded && i->device == device && i->buffer != keep)
+        {
+            victims.push_back(i->buffer);
+            used -= std::min<alureUInt64>(i->size, used);
+        }
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+
+    if(!victims.empty() && alGetError() == AL_NO_ERROR)
+    {
+        for(size_t j = 0;j < victims.size();j++)
+            evict_buffer(device, victims[j]);
+    }
+
+    EnterCriticalSection(&cs_BufferCache);
+    used = get_memory_used();
+    void (*callback)(void*,alureUInt64,alureUInt64) = MemoryPressureCallback;
+    void *userdata = MemoryPressureUserdata;
+    LeaveCriticalSection(&cs_BufferCache);
+
+    if(used > budget && callback)
+        callback(userdata, used, budget);
+}
+
+void UpdateStreamMemory(alureInt64 change)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    StreamMemoryUsed += change;
+    LeaveCriticalSection(&cs_BufferCache);
+
+    if(change > 0)
+        enforce_budget();
+}
+
+void MarkBufferUsed(ALuint buffer)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    EvictableList::iterator i = find_evictable(buffer);
+    if(i != EvictableBuffers.end())
+        EvictableBuffers.splice(EvictableBuffers.begin(), EvictableBuffers, i);
+    LeaveCriticalSection(&cs_BufferCache);
+}
+
+// Builds the cache key for a file, from its name, size, and modification
+// time. Files opened through user I/O callbacks can't be checked for changes,
+// so they aren't cached. Files in mounted packs don't change while mounted,
+// so they're keyed by their place in the pack instead.
+static std::string get_file_key(const char *fname)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    bool enabled = (BufferCacheMax > 0);
+    LeaveCriticalSection(&cs_BufferCache);
+    if(!enabled || !fname)
+        return std::string();
+
+    FileMapping entry;
+    if(MapPackEntry(fname, &entry))
+    {
+        std::string key = GetPackEntryKey(&entry);
+        UnmapPackEntry(&entry);
+        return key;
+    }
+
+    struct stat st;
+    if(!UsingSTDIO || stat(fname, &st) != 0)
+        return std::string();
+
+    std::ostringstream key;
+    key << "f:" << fname << '\0' << alureInt64(st.st_size) << ':' << alureInt64(st.st_mtime);
+    return key.str();
+}
+
+static std::string get_memory_key(const char *name)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    bool enabled = (BufferCacheMax > 0);
+    LeaveCriticalSection(&cs_BufferCache);
+
+    if(!enabled || !name || !name[0])
+        return std::string();
+    return std::string("m:") + name;
+}
+
+// Gives the decoded data its own copy of samples that point into the caller's
+// memory, so it can be kept after the call returns
+static bool own_data(DecodedData *decoded)
+{
+    if(decoded->owned || decoded->mapping.Data)
+        return true;
+
+    ALubyte *data = static_cast<ALubyte*>(malloc(std::max<ALuint>(decoded->size, 1)));
+    if(!data) return false;
+    memcpy(data, decoded->data, decoded->size);
+    decoded->data = data;
+    decoded->owned = true;
+    return true;
+}
+
+static std::string get_disk_cache_name(const char *fname)
+{
+    if(!fname)
+        return std::string();
+
+    EnterCriticalSection(&cs_BufferCache);
+    std::string dir = DiskCacheDir;
+    LeaveCriticalSection(&cs_BufferCache);
+    if(dir.empty())
+        return dir;
+
+    std::ostringstream name;
+    name << dir << '/';
+    name.fill('0');
+    name.width(16);
+    name << std::hex << HashBytes((const ALubyte*)fname, strlen(fname)) << ".pcm";
+    return name.str();
+}
+
+// Reads and validates a disk cache file. The file is mapped directly when
+// using the default I/O routines, and read through the I/O callbacks
+// otherwise.
+static bool read_disk_cache(const std::string &cacheName, const DiskCacheHeader &src, DecodedData *decoded)
+{
+    DiskCacheHeader header;
+    if(MapFile(cacheName.c_str(), &decoded->mapping))
+    {
+        if(decoded->mapping.Length < sizeof(header))
+        {
+            UnmapFile(&decoded->mapping);
+            return false;
+        }
+        memcpy(&header, decoded->mapping.Data, sizeof(header));
+        if(memcmp(header.magic, src.magic, sizeof(header.magic)) != 0 ||
+           header.version != src.version || header.srcSize != src.srcSize ||
+           header.srcTime != src.srcTime || header.srcHash != src.srcHash ||
+           decoded->mapping.Length-sizeof(header) != header.size ||
+           header.size == 0 || DetectBlockAlignment(header.format) == 0)
+        {
+            UnmapFile(&decoded->mapping);
+            return false;
+        }
+        decoded->data = const_cast<ALubyte*>(decoded->mapping.Data+sizeof(header));
+        decoded->owned = false;
+    }
+    else
+    {
+        InStream file(cacheName.c_str());
+        if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            return false;
+        if(memcmp(header.magic, src.magic, sizeof(header.magic)) != 0 ||
+           header.version != src.version || header.srcSize != src.srcSize ||
+           header.srcTime != src.srcTime || header.srcHash != src.srcHash ||
+           header.size == 0 || DetectBlockAlignment(header.format) == 0)
+            return false;
+
+        decoded->data = (ALubyte*)malloc(header.size);
+        if(!decoded->data)
+            return false;
+        if(!file.read(reinterpret_cast<char*>(decoded->data), header.size) ||
+           file.peek() != std::istream::traits_type::eof())
+        {
+            free(decoded->data);
+            decoded->data = NULL;
+            return false;
+        }
+    }
+
+    decoded->format = header.format;
+    decoded->freq = header.freq;
+    decoded->size = header.size;
+    return true;
+}
+
+// Returns a unique name next to the given cache file to write a new copy to
+static std::string get_disk_cache_temp_name(const std::string &cacheName)
+{
+    static ALuint TempCount = 0;
+
+    EnterCriticalSection(&cs_BufferCache);
+    ALuint count = TempCount++;
+    LeaveCriticalSection(&cs_BufferCache);
+
+    std::ostringstream name;
+#ifdef HAVE_WINDOWS_H
+    name << cacheName << '.' << GetCurrentProcessId() << '-' << count << ".tmp";
+#else
+    name << cacheName << '.' << getpid() << '-' << count << ".tmp";
+#endif
+    return name.str();
+}
+
+static bool replace_file(const std::string &from, const std::string &to)
+{
+#ifdef HAVE_WINDOWS_H
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Writes decoded data to a disk cache file through the I/O callbacks. The
+// existing cache file may be mapped by a buffer cache entry, so it's never
+// written to; the data goes to a new file that's then renamed over it. That
+// needs the default I/O routines, so nothing is written while user callbacks
+// are set. The header's magic is written last, so an interrupted write leaves
+// a file that won't be accepted.
+static void write_disk_cache(const std::string &cacheName, const DiskCacheHeader &src, const DecodedData &decoded)
+{
+    UserFuncs fio = Funcs;
+    if(!UsingSTDIO)
+        return;
+
+    std::string tempName = get_disk_cache_temp_name(cacheName);
+    void *file = fio.open(tempName.c_str(), 1);
+    if(!file)
+        return;
+
+    DiskCacheHeader header = src;
+    memset(header.magic, 0, sizeof(header.magic));
+    header.format = decoded.format;
+    header.freq = decoded.freq;
+    header.size = decoded.size;
+
+    bool ok = (fio.write(file, (const ALubyte*)&header, sizeof(header)) == sizeof(header));
+    ALuint done = 0;
+    while(ok && done < decoded.size)
+    {
+        ALuint todo = std::min<ALuint>(decoded.size-done, 1<<20);
+        ALsizei amt = fio.write(file, decoded.data+done, todo);
+        if(amt <= 0)
+            ok = false;
+        else
+            done += amt;
+    }
+    ok = ok && fio.seek(file, 0, SEEK_SET) == 0 &&
+         fio.write(file, (const ALubyte*)src.magic, sizeof(src.magic)) == sizeof(src.magic);
+    fio.close(file);
+
+    if(!ok || !replace_file(tempName, cacheName))
+        remove(tempName.c_str());
+}
+
+static bool decode_source(const MemDataInfo &memData, DecodedData *decoded)
+{
+    return decode_stream(create_stream(memData), decoded);
+}
+
+// Hashes the contents of the named file, read through the I/O callbacks, and
+// gets its CheckBytes value too if asked. Returns false if the file can't be
+// read or is empty.
+static bool hash_file(const char *fname, alureUInt64 *size, alureUInt64 *hash,
+                      alureUInt64 *check=NULL)
+{
+    InStream file(fname);
+    char buf[4096];
+
+    *size = 0;
+    *hash = HashBytes(NULL, 0);
+    if(check) *check = CheckBytes(NULL, 0);
+    while(file)
+    {
+        file.read(buf, sizeof(buf));
+        *size += file.gcount();
+        *hash = HashBytes((const ALubyte*)buf, file.gcount(), *hash);
+        if(check) *check = CheckBytes((const ALubyte*)buf, file.gcount(), *check);
+    }
+    return *size > 0;
+}
+
+// Decodes the named file, going through the disk cache if it's enabled. The
+// file is hashed to check it against the cache; a miss decodes it and stores
+// the result. Local files are mapped, so uncompressed samples can be used
+// straight from the mapping. Installed decode callbacks expect to open files
+// by name, so the mapping isn't decoded from when there are any.
+static bool decode_source(const char *fname, DecodedData *decoded)
+{
+    std::string cacheName = get_disk_cache_name(fname);
+
+    FileMapping srcMap;
+    bool mapped = MapFile(fname, &srcMap);
+
+    DiskCacheHeader header;
+    if(!cacheName.empty())
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DiskCacheMagic, sizeof(header.magic));
+        header.version = DiskCacheVersion;
+
+        if(mapped)
+        {
+            header.srcSize = srcMap.Length;
+            header.srcHash = HashBytes(srcMap.Data, srcMap.Length);
+        }
+        else if(!hash_file(fname, &header.srcSize, &header.srcHash))
+            cacheName.clear();
+
+        // Pack entries are checked by their size and hash alone
+        struct stat st;
+        if(!srcMap.Pack && UsingSTDIO && stat(fname, &st) == 0)
+            header.srcTime = st.st_mtime;
+
+        if(!cacheName.empty() && read_disk_cache(cacheName, header, decoded))
+        {
+            UnmapFile(&srcMap);
+            return true;
+        }
+    }
+
+    bool ret;
+    if(mapped && InstalledCallbacks.empty())
+    {
+        MemDataInfo memData;
+        memData.Data = srcMap.Data;
+        memData.Length = srcMap.Length;
+        memData.Pos = 0;
+        ret = decode_stream(create_stream(memData), decoded);
+    }
+    else
+        ret = decode_stream(create_stream(fname), decoded);
+
+    if(ret && !decoded->owned)
+    {
+        // The samples are used from the mapping, so keep it. There's no point
+        // in caching them on disk too.
+        if(!decoded->mapping.Data)
+            decoded->mapping = srcMap;
+        else
+            UnmapFile(&srcMap);
+        return true;
+    }
+    UnmapFile(&srcMap);
+
+    if(ret && !cacheName.empty())
+        write_disk_cache(cacheName, header, *decoded);
+    return ret;
+}
+
+// Returns the decoded data for the given file or memory image, from the
+// buffer cache if possible. A non-empty key enables caching. The returned
+// data must be released with release_decoded. This runs on worker threads
+// too, so the callers enforce the memory budget once they've uploaded it.
+template <typename T>
+static DecodedData *get_decoded(const T &fdata, const std::string &key)
+{
+    if(!key.empty())
+    {
+        EnterCriticalSection(&cs_BufferCache);
+        BufferCacheMap::iterator i = BufferCacheIndex.find(key);
+        if(i != BufferCacheIndex.end())
+        {
+            DecodedData *decoded = *(i->second);
+            BufferCache.splice(BufferCache.begin(), BufferCache, i->second);
+            decoded->refs++;
+            LeaveCriticalSection(&cs_BufferCache);
+            return decoded;
+        }
+        LeaveCriticalSection(&cs_BufferCache);
+    }
+
+    std::auto_ptr<DecodedData> decoded(new DecodedData);
+    if(!decode_source(fdata, decoded.get()))
+        return NULL;
+
+    if(!key.empty() && own_data(decoded.get()))
+    {
+        EnterCriticalSection(&cs_BufferCache);
+        if(decoded->size <= BufferCacheMax &&
+           BufferCacheIndex.find(key) == BufferCacheIndex.end())
+        {
+            decoded->key = key;
+            decoded->refs++;
+            BufferCache.push_front(decoded.get());
+            BufferCacheIndex[key] = BufferCache.begin();
+            BufferCacheUsed += decoded->size;
+            trim_cache(BufferCacheMax);
+        }
+        LeaveCriticalSection(&cs_BufferCache);
+    }
+
+    return decoded.release();
+}
+
+template <typename T>
+static bool load_data(const T &fdata, const std::string &key, ALuint buffer)
+{
+    DecodedData *decoded = get_decoded(fdata, key);
+    if(!decoded)
+        return false;
+
+    bool ret = upload_data(*decoded, buffer);
+    release_decoded(decoded);
+    enforce_budget(buffer);
+    return ret;
+}
+
+
+// State shared between the threads of a batch load. Each decoded item is
+// uploaded by the calling thread, which owns the context.
+struct BatchLoad {
+    const ALchar *const *fnames;
+    const ALubyte *const *fdata;
+    const ALsizei *lengths;
+    ALsizei count;
+    ALCcontext *ctx;
+
+    CRITICAL_SECTION lock;
+    ALsizei next;
+    std::vector<DecodedData*> decoded;
+    std::vector<ALubyte> state;
+
+    enum { Pending, Decoded, Failed, Done };
+
+    BatchLoad(ALsizei _count)
+      : fnames(NULL), fdata(NULL), lengths(NULL), count(_count), ctx(NULL),
+        next(0), decoded(_count, NULL), state(_count, Pending)
+    { InitializeCriticalSection(&lock); }
+    ~BatchLoad()
+    {
+        for(ALsizei i = 0;i < count;i++)
+        {
+            if(decoded[i])
+                release_decoded(decoded[i]);
+        }
+        DeleteCriticalSection(&lock);
+    }
+
+    // Decodes the next unclaimed item. Returns false when there are none
+    // left.
+    bool DecodeNext()
+    {
+        EnterCriticalSection(&lock);
+        ALsizei idx = next;
+        if(idx < count) next++;
+        LeaveCriticalSection(&lock);
+        if(idx >= count)
+            return false;
+
+        DecodedData *data = NULL;
+        if(fnames)
+            data = get_decoded(fnames[idx], get_file_key(fnames[idx]));
+        else if(lengths[idx] < 0)
+            SetError("Invalid data length");
+        else
+        {
+            MemDataInfo memData;
+            memData.Data = fdata[idx];
+            memData.Length = lengths[idx];
+            memData.Pos = 0;
+            data = get_decoded(memData, std::string());
+        }
+
+        EnterCriticalSection(&lock);
+        decoded[idx] = data;
+        state[idx] = (data ? Decoded : Failed);
+        LeaveCriticalSection(&lock);
+        return true;
+    }
+
+    // Uploads every item that has finished decoding since the last call.
+    // Called only from the thread owning the context.
+    void UploadFinished(ALuint *bufs)
+    {
+        for(ALsizei i = 0;i < count;i++)
+        {
+            EnterCriticalSection(&lock);
+            ALubyte st = state[i];
+            if(st == Decoded || st == Failed)
+                state[i] = Done;
+            LeaveCriticalSection(&lock);
+
+            if(st != Decoded && st != Failed)
+                continue;
+
+            bool ok = (st == Decoded && upload_data(*decoded[i], bufs[i]));
+            if(decoded[i])
+            {
+                release_decoded(decoded[i]);
+                decoded[i] = NULL;
+            }
+            if(!ok)
+            {
+                alDeleteBuffers(1, &bufs[i]);
+                alGetError();
+                bufs[i] = AL_NONE;
+            }
+        }
+    }
+};
+
+static ALuint batch_worker(ALvoid *ptr)
+{
+    BatchLoad *batch = static_cast<BatchLoad*>(ptr);
+
+    // Decoders may query the context for supported formats
+    if(alcSetThreadContext)
+        alcSetThreadContext(batch->ctx);
+    while(batch->DecodeNext())
+    {
+    }
+    if(alcSetThreadContext)
+        alcSetThreadContext(NULL);
+    return 0;
+}
+
+static ALsizei load_batch(BatchLoad &batch, ALuint *bufs)
+{
+    alGenBuffers(batch.count, bufs);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer creation failed");
+        return -1;
+    }
+
+    batch.ctx = alcGetCurrentContext();
+
+    // The calling thread decodes alongside the workers, uploading whatever
+    // has finished between its own items
+    std::vector<ThreadInfo*> threads;
+    ALuint numThreads = std::min<ALuint>(GetProcessorCount(), batch.count);
+    while(threads.size()+1 < numThreads)
+    {
+        ThreadInfo *thread = StartThread(batch_worker, &batch);
+        if(!thread) break;
+        threads.push_back(thread);
+    }
+
+    while(batch.DecodeNext())
+        batch.UploadFinished(bufs);
+    for(size_t i = 0;i < threads.size();i++)
+        StopThread(threads[i]);
+    batch.UploadFinished(bufs);
+    enforce_budget();
+
+    ALsizei loaded = 0;
+    for(ALsizei i = 0;i < batch.count;i++)
+    {
+        if(bufs[i] != AL_NONE)
+            loaded++;
+    }
+    return loaded;
+}
+
+
+static ALuint create_buffer(const DecodedData &decoded)
+{
+    ALuint buf;
+    alGenBuffers(1, &buf);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer creation failed");
+        return AL_NONE;
+    }
+
+    if(!upload_data(decoded, buf))
+    {
+        alDeleteBuffers(1, &buf);
+        alGetError();
+        buf = AL_NONE;
+    }
+    return buf;
+}
+
+
+// Buffers shared between loads of identical data, identified by two
+// unrelated hashes and the length of the encoded data, so different data
+// can't be mistaken for the same by one hash colliding. Buffers belong to a
+// device, so the device is part of the key. Protected by cs_BufferCache.
+struct SharedBufferKey {
+    ALCdevice *device;
+    alureUInt64 hash;
+    alureUInt64 check;
+    alureUInt64 length;
+
+    bool operator<(const SharedBufferKey &rhs) const
+    {
+        if(device != rhs.device) return device < rhs.device;
+        if(hash != rhs.hash) return hash < rhs.hash;
+        if(check != rhs.check) return check < rhs.check;
+        return length < rhs.length;
+    }
+};
+struct SharedBuffer {
+    ALuint buffer;
+    ALuint size;
+    ALuint refs;
+};
+typedef std::map<SharedBufferKey,SharedBuffer> SharedBufferMap;
+static SharedBufferMap SharedBuffers;
+static std::map<std::pair<ALCdevice*,ALuint>,SharedBufferMap::iterator> SharedBufferIndex;
+
+// Returns a new reference to the shared buffer with the given key, loading
+// it from the given file or memory image if there isn't one yet
+template <typename T>
+static ALuint get_shared_buffer(const T &fdata, const std::string &cacheKey, const SharedBufferKey &key)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    SharedBufferMap::iterator i = SharedBuffers.find(key);
+    if(i != SharedBuffers.end())
+    {
+        i->second.refs++;
+        ALuint buf = i->second.buffer;
+        LeaveCriticalSection(&cs_BufferCache);
+        return buf;
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+
+    DecodedData *decoded = get_decoded(fdata, cacheKey);
+    if(!decoded)
+        return AL_NONE;
+    ALuint buf = create_buffer(*decoded);
+    ALuint size = decoded->size;
+    release_decoded(decoded);
+    if(!buf)
+        return AL_NONE;
+
+    EnterCriticalSection(&cs_BufferCache);
+    i = SharedBuffers.find(key);
+    if(i != SharedBuffers.end())
+    {
+        // Another thread loaded the same data in the mean time
+        alDeleteBuffers(1, &buf);
+        i->second.refs++;
+        buf = i->second.buffer;
+    }
+    else
+    {
+        SharedBuffer shared;
+        shared.buffer = buf;
+        shared.size = size;
+        shared.refs = 1;
+        i = SharedBuffers.insert(std::make_pair(key, shared)).first;
+        SharedBufferIndex[std::make_pair(key.device, buf)] = i;
+        SharedBufferMemoryUsed += size;
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+    enforce_budget();
+
+    return buf;
+}
+
+
+// A request made with one of the async buffer loading functions. Requests are
+// decoded in order by a background thread, which also uploads the data when
+// it can set its thread context to the requesting context. Otherwise, the
+// upload is left for alureUpdate, which also calls the callback.
+struct AsyncLoad {
+    ALuint id;
+    std::string fname;
+    MemDataInfo memData;
+    bool fromFile;
+    void (*callback)(void*,ALuint,ALuint);
+    void *userdata;
+    ALCcontext *ctx;
+
+    enum { Queued, Decoding, Decoded, Finished } state;
+    bool cancelled;
+    DecodedData *decoded;
+    ALuint buffer;
+
+    AsyncLoad() : id(0), fromFile(false), callback(NULL), userdata(NULL),
+                  ctx(NULL), state(Queued), cancelled(false), decoded(NULL),
+                  buffer(AL_NONE)
+    { }
+    ~AsyncLoad()
+    {
+        if(decoded)
+            release_decoded(decoded);
+    }
+};
+
+// Makes the context a load was requested from current on this thread, so its
+// buffer is made or deleted there. Without ALC_EXT_thread_local_context, this
+// only works if it's already the current context. The previous thread context
+// is stored for leave_load_context. Returns false on failure.
+static bool enter_load_context(const AsyncLoad *load, ALCcontext **old_ctx)
+{
+    *old_ctx = (alcGetThreadContext ? alcGetThreadContext() : NULL);
+    if(alcSetThreadContext)
+        return alcSetThreadContext(load->ctx) != ALC_FALSE;
+    return alcGetCurrentContext() == load->ctx;
+}
+
+static void leave_load_context(ALCcontext *old_ctx)
+{
+    if(alcSetThreadContext && alcSetThreadContext(old_ctx) == ALC_FALSE)
+        alcSetThreadContext(NULL);
+}
+
+// Everything here is protected by cs_BufferLoad. The list is never deleted,
+// like the buffer cache, since deinit_alure uses it.
+static std::list<AsyncLoad*> &AsyncLoadList = *new std::list<AsyncLoad*>;
+static ThreadInfo *AsyncLoadThread;
+static bool AsyncLoadRunning = false;
+static ALuint NextAsyncLoadId = 1;
+
+static ALuint async_load_worker(ALvoid*)
+{
+    EnterCriticalSection(&cs_BufferLoad);
+    while(1)
+    {
+        std::list<AsyncLoad*>::iterator i = AsyncLoadList.begin();
+        while(i != AsyncLoadList.end() && (*i)->state != AsyncLoad::Queued)
+            i++;
+        if(i == AsyncLoadList.end())
+            break;
+
+        AsyncLoad *load = *i;
+        load->state = AsyncLoad::Decoding;
+        LeaveCriticalSection(&cs_BufferLoad);
+
+        bool haveCtx = (alcSetThreadContext && alcSetThreadContext(load->ctx));
+        DecodedData *decoded = (load->fromFile ?
+                                get_decoded(load->fname.c_str(), get_file_key(load->fname.c_str())) :
+                                get_decoded(load->memData, std::string()));
+        ALuint buffer = AL_NONE;
+        if(decoded && haveCtx)
+        {
+            buffer = create_buffer(*decoded);
+            release_decoded(decoded);
+            decoded = NULL;
+        }
+
+        EnterCriticalSection(&cs_BufferLoad);
+        if(load->cancelled)
+        {
+            AsyncLoadList.remove(load);
+            if(buffer)
+                alDeleteBuffers(1, &buffer);
+            if(decoded)
+                release_decoded(decoded);
+            delete load;
+            continue;
+        }
+        load->decoded = decoded;
+        load->buffer = buffer;
+        load->state = (decoded ? AsyncLoad::Decoded : AsyncLoad::Finished);
+    }
+    AsyncLoadRunning = false;
+    LeaveCriticalSection(&cs_BufferLoad);
+
+    if(alcSetThreadContext)
+        alcSetThreadContext(NULL);
+    return 0;
+}
+
+static ALuint queue_async_load(AsyncLoad *load)
+{
+    load->ctx = alcGetCurrentContext();
+
+    EnterCriticalSection(&cs_BufferLoad);
+    if(!AsyncLoadRunning)
+    {
+        if(AsyncLoadThread)
+            StopThread(AsyncLoadThread);
+        AsyncLoadThread = StartThread(async_load_worker, NULL);
+        if(!AsyncLoadThread)
+        {
+            LeaveCriticalSection(&cs_BufferLoad);
+            SetError("Error starting async thread");
+            delete load;
+            return 0;
+        }
+        AsyncLoadRunning = true;
+    }
+
+    load->id = NextAsyncLoadId++;
+    if(NextAsyncLoadId == 0) NextAsyncLoadId = 1;
+    AsyncLoadList.push_back(load);
+
+    ALuint id = load->id;
+    LeaveCriticalSection(&cs_BufferLoad);
+    return id;
+}
+
+// Uploads finished async loads that the background thread couldn't, in the
+// contexts they were requested from, and calls their callbacks. Loads whose
+// context can't be made current get AL_NONE. Called by alureUpdate.
+void UpdateBufferLoads(void)
+{
+    std::vector<AsyncLoad*> done;
+
+    EnterCriticalSection(&cs_BufferLoad);
+    std::list<AsyncLoad*>::iterator i = AsyncLoadList.begin();
+    while(i != AsyncLoadList.end())
+    {
+        if((*i)->state == AsyncLoad::Decoded || (*i)->state == AsyncLoad::Finished)
+        {
+            done.push_back(*i);
+            i = AsyncLoadList.erase(i);
+        }
+        else
+            i++;
+    }
+    LeaveCriticalSection(&cs_BufferLoad);
+
+    for(size_t j = 0;j < done.size();j++)
+    {
+        AsyncLoad *load = done[j];
+        ALCcontext *old_ctx;
+        if(load->decoded && enter_load_context(load, &old_ctx))
+        {
+            load->buffer = create_buffer(*load->decoded);
+            enforce_budget(load->buffer);
+            leave_load_context(old_ctx);
+        }
+        load->callback(load->userdata, load->id, load->buffer);
+        delete load;
+    }
+}
+
+// Drops all pending async loads, and waits for the background thread to
+// finish. Buffers already made for loads are deleted in their context, if it
+// can still be made current.
+void StopBufferLoads(void)
+{
+    EnterCriticalSection(&cs_BufferLoad);
+    std::list<AsyncLoad*>::iterator i = AsyncLoadList.begin();
+    while(i != AsyncLoadList.end())
+    {
+        AsyncLoad *load = *i;
+        if(load->state == AsyncLoad::Decoding)
+        {
+            load->cancelled = true;
+            i++;
+            continue;
+        }
+        ALCcontext *old_ctx;
+        if(load->buffer && enter_load_context(load, &old_ctx))
+        {
+            alDeleteBuffers(1, &load->buffer);
+            alGetError();
+            leave_load_context(old_ctx);
+        }
+        delete load;
+        i = AsyncLoadList.erase(i);
+    }
+    ThreadInfo *thread = AsyncLoadThread;
+    AsyncLoadThread = NULL;
+    LeaveCriticalSection(&cs_BufferLoad);
+
+    if(thread)
+        StopThread(thread);
+}
+
+
+extern "C" {
+
+/* Function: alureCreateBufferFromFile
+ *
+ * Loads the given file into a new OpenAL buffer object. The formats supported
+ * depend on the options the library was compiled with, what libraries are
+ * available at runtime, and the installed decode callbacks. Requires an active
+ * context.
+ *
+ * Returns:
+ * A new buffer ID with the loaded sound, or AL_NONE on error.
+ *
+ * See Also:
+ * <alureBufferDataFromFile>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFile(const ALchar *fname)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_NONE;
+    }
+
+    ALuint buf;
+    alGenBuffers(1, &buf);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer creation failed");
+        return AL_NONE;
+    }
+
+    if(alureBufferDataFromFile(fname, buf) == AL_FALSE)
+    {
+        alDeleteBuffers(1, &buf);
+        alGetError();
+        buf = AL_NONE;
+    }
+
+    return buf;
+}
+
+/* Function: alureCreateBufferFromMemory
+ *
+ * Loads a file image from memory into a new OpenAL buffer object, similar to
+ * alureCreateBufferFromFile. Requires an active context.
+ *
+ * Returns:
+ * A new buffer ID with the loaded sound, or AL_NONE on error.
+ *
+ * See Also:
+ * <alureBufferDataFromMemory>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemory(const ALubyte *fdata, ALsizei length)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_NONE;
+    }
+
+    ALuint buf;
+    alGenBuffers(1, &buf);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer creation failed");
+        return AL_NONE;
+    }
+
+    if(alureBufferDataFromMemory(fdata, length, buf) == AL_FALSE)
+    {
+        alDeleteBuffers(1, &buf);
+        alGetError();
+        buf = AL_NONE;
+    }
+
+    return buf;
+}
+
+/* Function: alureBufferDataFromFile
+ *
+ * Loads the given file into an existing OpenAL buffer object. The previous
+ * contents of the buffer are replaced. Requires an active context.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * See Also:
+ * <alureCreateBufferFromFile>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromFile(const ALchar *fname, ALuint buffer)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_FALSE;
+    }
+
+    if(!buffer || !alIsBuffer(buffer))
+    {
+        SetError("Invalid buffer ID");
+        return false;
+    }
+
+    if(load_data(fname, get_file_key(fname), buffer) == false)
+        return AL_FALSE;
+    return AL_TRUE;
+}
+
+/* Function: alureBufferDataFromMemory
+ *
+ * Loads a file image from memory into an existing OpenAL buffer object,
+ * similar to alureBufferDataFromFile. Requires an active context.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * See Also:
+ * <alureCreateBufferFromMemory>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemory(const ALubyte *fdata, ALsizei length, ALuint buffer)
+{
+    return alureBufferDataFromMemoryKeyed(NULL, fdata, length, buffer);
+}
+
+/* Function: alureCreateBufferFromFileRange
+ *
+ * Loads the sample frames [start, end) of the given file into a new OpenAL
+ * buffer object. The decoder is seeked to the start frame, and only the
+ * requested frames are decoded. For block-compressed formats (eg. IMA4), the
+ * range is rounded out to whole blocks. A range extending past the end of the
+ * sound is cut short. The buffer cache is not used. Requires an active
+ * context.
+ *
+ * Returns:
+ * A new buffer ID with the loaded frames, or AL_NONE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromMemoryRange>, <alureCreateBufferFromFile>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFileRange(const ALchar *fname, alureUInt64 start, alureUInt64 end)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_NONE;
+    }
+
+    if(end <= start)
+    {
+        SetError("Invalid range");
+        return AL_NONE;
+    }
+
+    DecodedData decoded;
+    if(!decode_stream(create_stream(fname), &decoded, start, end))
+        return AL_NONE;
+    return create_buffer(decoded);
+}
+
+/* Function: alureCreateBufferFromMemoryRange
+ *
+ * Loads the sample frames [start, end) of a file image from memory into a new
+ * OpenAL buffer object, similar to <alureCreateBufferFromFileRange>. Requires
+ * an active context.
+ *
+ * Returns:
+ * A new buffer ID with the loaded frames, or AL_NONE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromFileRange>, <alureCreateBufferFromMemory>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryRange(const ALubyte *fdata, ALsizei length, alureUInt64 start, alureUInt64 end)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_NONE;
+    }
+
+    if(length < 0)
+    {
+        SetError("Invalid data length");
+        return AL_NONE;
+    }
+    if(end <= start)
+    {
+        SetError("Invalid range");
+        return AL_NONE;
+    }
+
+    MemDataInfo memData;
+    memData.Data = fdata;
+    memData.Length = length;
+    memData.Pos = 0;
+
+    DecodedData decoded;
+    if(!decode_stream(create_stream(memData), &decoded, start, end))
+        return AL_NONE;
+    return create_buffer(decoded);
+}
+
+/* Function: alureCreateBufferFromMemoryKeyed
+ *
+ * Loads a file image from memory into a new OpenAL buffer object, similar to
+ * <alureCreateBufferFromMemory>. The given key identifies the image in the
+ * buffer cache (see <alureSetBufferCacheSize>), so later loads with the same
+ * key can skip decoding. The caller must not reuse a key for different data
+ * while the cache is enabled. A NULL or empty key disables caching for the
+ * call. Requires an active context.
+ *
+ * Returns:
+ * A new buffer ID with the loaded sound, or AL_NONE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureBufferDataFromMemoryKeyed>, <alureSetBufferCacheSize>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryKeyed(const ALchar *key, const ALubyte *fdata, ALsizei length)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_NONE;
+    }
+
+    ALuint buf;
+    alGenBuffers(1, &buf);
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Buffer creation failed");
+        return AL_NONE;
+    }
+
+    if(alureBufferDataFromMemoryKeyed(key, fdata, length, buf) == AL_FALSE)
+    {
+        alDeleteBuffers(1, &buf);
+        alGetError();
+        buf = AL_NONE;
+    }
+
+    return buf;
+}
+
+/* Function: alureBufferDataFromMemoryKeyed
+ *
+ * Loads a file image from memory into an existing OpenAL buffer object,
+ * similar to <alureBufferDataFromMemory>, using the given key to identify the
+ * image in the buffer cache. Requires an active context.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromMemoryKeyed>, <alureSetBufferCacheSize>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemoryKeyed(const ALchar *key, const ALubyte *fdata, ALsizei length, ALuint buffer)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return AL_FALSE;
+    }
+
+    if(!buffer || !alIsBuffer(buffer))
+    {
+        SetError("Invalid buffer ID");
+        return false;
+    }
+
+    if(length < 0)
+    {
+        SetError("Invalid data length");
+        return AL_FALSE;
+    }
+
+    MemDataInfo memData;
+    memData.Data = fdata;
+    memData.Length = length;
+    memData.Pos = 0;
+
+    if(load_data(memData, get_memory_key(key), buffer) == false)
+        return AL_FALSE;
+    return AL_TRUE;
+}
+
+/* Function: alureSetBufferCacheSize
+ *
+ * Sets the maximum number of bytes of decoded audio kept in memory by the
+ * buffer cache. When enabled, the buffer loading functions keep the decoded
+ * data of the sounds they load, so loading the same sound again (into any
+ * buffer, on any context) uploads the kept data directly instead of decoding
+ * the file again. Files are identified by name, size, and modification time,
+ * and memory images by a caller-supplied key. The least recently used sounds
+ * are dropped to stay within the given size. Files opened through callbacks
+ * set with <alureSetIOCallbacks> are not cached. A size of 0 (the default)
+ * disables the cache and frees everything in it.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromMemoryKeyed>, <alureBufferDataFromMemoryKeyed>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetBufferCacheSize(alureUInt64 size)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    BufferCacheMax = size;
+    trim_cache(BufferCacheMax);
+    LeaveCriticalSection(&cs_BufferCache);
+
+    return AL_TRUE;
+}
+
+/* Function: alureSetDiskCacheDirectory
+ *
+ * Sets the directory used to keep decoded audio on disk between runs. When
+ * set, loading a file into a buffer stores its decoded samples and format in
+ * this directory, and later loads of the same unchanged file (including from
+ * later runs of the application) read them back instead of decoding the file
+ * again. Files are checked for changes by their size, modification time, and
+ * a hash of their contents. Existing cache files are read with the I/O
+ * callbacks (see <alureSetIOCallbacks>), or mapped directly into memory when
+ * using the default I/O routines. New cache files are only written when using
+ * the default I/O routines, since they're replaced by renaming a new file over
+ * the old one. The directory must already exist. A NULL or empty path (the
+ * default) disables the disk cache. Only files are cached; memory images are
+ * not.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureSetBufferCacheSize>, <alureSetIOCallbacks>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetDiskCacheDirectory(const ALchar *path)
 {
-    if(!_stream)
-        return false;
+    std::string dir(path ? path : "");
+    while(dir.length() > 1 && (dir[dir.length()-1] == '/' || dir[dir.length()-1] == '\\'))
+        dir.erase(dir.length()-1);
 
-    std::auto_ptr<std::istream> fstream(_stream->fstream);
-    std::auto_ptr<alureStream> stream(_stream);
+    EnterCriticalSection(&cs_BufferCache);
+    DiskCacheDir = dir;
+    LeaveCriticalSection(&cs_BufferCache);
 
-    ALenum format;
-    ALuint freq, blockAlign;
+    return AL_TRUE;
+}
 
-    if(!stream->GetFormat(&format, &freq, &blockAlign))
+/* Function: alureCreateBufferFromFileAsync
+ *
+ * Starts loading the given file into a new OpenAL buffer object in the
+ * background, and returns without waiting for it. The file is decoded by a
+ * background thread, and uploaded to OpenAL either by that thread (when
+ * ALC_EXT_thread_local_context is supported) or during the next call to
+ * <alureUpdate>. Once done, the callback is called from <alureUpdate>. Requires
+ * an active context, which should be kept for <alureUpdate> calls if
+ * ALC_EXT_thread_local_context is not supported.
+ *
+ * Parameters:
+ * fname - The file to load.
+ * callback - Called with the given userdata, the request handle, and the new
+ *            buffer ID once the load finishes. The buffer ID is AL_NONE if
+ *            the load failed. The application owns the buffer from then on.
+ * userdata - An opaque user pointer passed to the callback.
+ *
+ * Returns:
+ * A non-zero handle for the request, or 0 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromMemoryAsync>, <alureCancelBufferLoad>,
+ * <alureIsBufferLoadPending>, <alureUpdate>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFileAsync(const ALchar *fname,
+    void (*callback)(void *userdata, ALuint request, ALuint buffer), void *userdata)
+{
+    if(!fname)
     {
-        SetError("Could not get sample format");
-        return false;
+        SetError("Invalid filename");
+        return 0;
     }
-
-    if(format == AL_NONE)
+    if(!callback)
     {
-        SetError("No valid format");
-        return false;
+        SetError("Missing callback");
+        return 0;
     }
-    if(blockAlign == 0)
+
+    AsyncLoad *load = new AsyncLoad;
+    load->fname = fname;
+    load->fromFile = true;
+    load->callback = callback;
+    load->userdata = userdata;
+    return queue_async_load(load);
+}
+
+/* Function: alureCreateBufferFromMemoryAsync
+ *
+ * Starts loading a file image from memory into a new OpenAL buffer object in
+ * the background, similar to <alureCreateBufferFromFileAsync>. The memory
+ * must stay valid until the callback is called or the request is canceled.
+ * Requires an active context.
+ *
+ * Returns:
+ * A non-zero handle for the request, or 0 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBufferFromFileAsync>, <alureCancelBufferLoad>,
+ * <alureIsBufferLoadPending>, <alureUpdate>
+ */
+ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemoryAsync(const ALubyte *fdata, ALsizei length,
+    void (*callback)(void *userdata, ALuint request, ALuint buffer), void *userdata)
+{
+    if(length < 0)
     {
-        SetError("Invalid block size");
-        return false;
+        SetError("Invalid data length");
+        return 0;
     }
-    if(freq == 0)
+    if(!callback)
     {
-        SetError("Invalid sample rate");
-        return false;
+        SetError("Missing callback");
+        return 0;
     }
 
-    ALuint writePos = 0, got;
-    std::vector<ALubyte> data(freq*blockAlign);
-    while((got=stream->GetData(&data[writePos], data.size()-writePos)) > 0)
+    AsyncLoad *load = new AsyncLoad;
+    load->memData.Data = fdata;
+    load->memData.Length = length;
+    load->memData.Pos = 0;
+    load->callback = callback;
+    load->userdata = userdata;
+    return queue_async_load(load);
+}
+
+/* Function: alureCancelBufferLoad
+ *
+ * Cancels a request made with <alureCreateBufferFromFileAsync> or
+ * <alureCreateBufferFromMemoryAsync>. Its callback will not be called, and
+ * any buffer already created for it is deleted. A request that is currently
+ * being decoded is dropped once the decode finishes. Requires an active
+ * context.
+ *
+ * Returns:
+ * AL_FALSE on error, or if the request is no longer pending.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureIsBufferLoadPending>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureCancelBufferLoad(ALuint request)
+{
+    EnterCriticalSection(&cs_BufferLoad);
+    std::list<AsyncLoad*>::iterator i = AsyncLoadList.begin();
+    while(i != AsyncLoadList.end() && ((*i)->id != request || (*i)->cancelled))
+        i++;
+    if(i == AsyncLoadList.end())
     {
-        writePos += got;
-        data.resize(writePos + freq*blockAlign);
+        LeaveCriticalSection(&cs_BufferLoad);
+        SetError("Invalid request handle");
+        return AL_FALSE;
     }
-    data.resize(writePos - (writePos%blockAlign));
-    stream.reset(NULL);
 
-    alBufferData(buffer, format, &data[0], data.size(), freq);
-    if(alGetError() != AL_NO_ERROR)
+    AsyncLoad *load = *i;
+    if(load->state == AsyncLoad::Decoding)
+        load->cancelled = true;
+    else
     {
-        SetError("Buffer load failed");
-        return false;
+        AsyncLoadList.erase(i);
+        ALCcontext *old_ctx;
+        if(load->buffer && enter_load_context(load, &old_ctx))
+        {
+            alDeleteBuffers(1, &load->buffer);
+            alGetError();
+            leave_load_context(old_ctx);
+        }
+        delete load;
     }
+    LeaveCriticalSection(&cs_BufferLoad);
 
-    return true;
+    return AL_TRUE;
 }
 
-extern "C" {
+/* Function: alureIsBufferLoadPending
+ *
+ * Checks if a request made with <alureCreateBufferFromFileAsync> or
+ * <alureCreateBufferFromMemoryAsync> is still pending, ie. it has neither had
+ * its callback called nor been canceled. A request of 0 checks if any request
+ * is pending.
+ *
+ * Returns:
+ * AL_TRUE if the request is pending, AL_FALSE otherwise.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCancelBufferLoad>, <alureUpdate>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureIsBufferLoadPending(ALuint request)
+{
+    ALboolean ret = AL_FALSE;
 
-/* Function: alureCreateBufferFromFile
+    EnterCriticalSection(&cs_BufferLoad);
+    std::list<AsyncLoad*>::iterator i = AsyncLoadList.begin();
+    for(;i != AsyncLoadList.end() && !ret;i++)
+    {
+        if(!(*i)->cancelled && (request == 0 || (*i)->id == request))
+            ret = AL_TRUE;
+    }
+    LeaveCriticalSection(&cs_BufferLoad);
+
+    return ret;
+}
+
+/* Function: alureCreateSharedBufferFromFile
  *
- * Loads the given file into a new OpenAL buffer object. The formats supported
- * depend on the options the library was compiled with, what libraries are
- * available at runtime, and the installed decode callbacks. Requires an active
+ * Loads the given file into an OpenAL buffer object that is shared with other
+ * loads of identical data, similar to <alureCreateBufferFromFile>. Files are
+ * identified by a hash of their contents, so the same sound stored under
+ * several names is only decoded and uploaded once per device. Each call
+ * returns a new reference to the buffer, which must be released with
+ * <alureReleaseSharedBuffer> instead of being deleted. Requires an active
  * context.
  *
  * Returns:
- * A new buffer ID with the loaded sound, or AL_NONE on error.
+ * A shared buffer ID with the loaded sound, or AL_NONE on error.
+ *
+ * *Version Added*: 1.3
  *
  * See Also:
- * <alureBufferDataFromFile>
+ * <alureCreateSharedBufferFromMemory>, <alureReleaseSharedBuffer>
  */
-ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFile(const ALchar *fname)
+ALURE_API ALuint ALURE_APIENTRY alureCreateSharedBufferFromFile(const ALchar *fname)
 {
     if(alGetError() != AL_NO_ERROR)
     {
@@ -109,36 +1790,54 @@ ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromFile(const ALchar *fname)
         return AL_NONE;
     }
 
-    ALuint buf;
-    alGenBuffers(1, &buf);
-    if(alGetError() != AL_NO_ERROR)
+    if(!fname)
     {
-        SetError("Buffer creation failed");
+        SetError("Invalid filename");
         return AL_NONE;
     }
 
-    if(alureBufferDataFromFile(fname, buf) == AL_FALSE)
+    ALCcontext *ctx = alcGetCurrentContext();
+    if(!ctx)
     {
-        alDeleteBuffers(1, &buf);
-        alGetError();
-        buf = AL_NONE;
+        SetError("No active context");
+        return AL_NONE;
     }
 
-    return buf;
+    SharedBufferKey key;
+    key.device = alcGetContextsDevice(ctx);
+
+    FileMapping srcMap;
+    if(MapFile(fname, &srcMap))
+    {
+        key.length = srcMap.Length;
+        key.hash = HashBytes(srcMap.Data, srcMap.Length);
+        key.check = CheckBytes(srcMap.Data, srcMap.Length);
+        UnmapFile(&srcMap);
+    }
+    else if(!hash_file(fname, &key.length, &key.hash, &key.check))
+    {
+        SetError("Failed to open file");
+        return AL_NONE;
+    }
+
+    return get_shared_buffer(fname, get_file_key(fname), key);
 }
 
-/* Function: alureCreateBufferFromMemory
+/* Function: alureCreateSharedBufferFromMemory
  *
- * Loads a file image from memory into a new OpenAL buffer object, similar to
- * alureCreateBufferFromFile. Requires an active context.
+ * Loads a file image from memory into an OpenAL buffer object that is shared
+ * with other loads of identical data, similar to
+ * <alureCreateSharedBufferFromFile>. Requires an active context.
  *
  * Returns:
- * A new buffer ID with the loaded sound, or AL_NONE on error.
+ * A shared buffer ID with the loaded sound, or AL_NONE on error.
+ *
+ * *Version Added*: 1.3
  *
  * See Also:
- * <alureBufferDataFromMemory>
+ * <alureCreateSharedBufferFromFile>, <alureReleaseSharedBuffer>
  */
-ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemory(const ALubyte *fdata, ALsizei length)
+ALURE_API ALuint ALURE_APIENTRY alureCreateSharedBufferFromMemory(const ALubyte *fdata, ALsizei length)
 {
     if(alGetError() != AL_NO_ERROR)
     {
@@ -146,66 +1845,165 @@ ALURE_API ALuint ALURE_APIENTRY alureCreateBufferFromMemory(const ALubyte *fdata
         return AL_NONE;
     }
 
-    ALuint buf;
-    alGenBuffers(1, &buf);
-    if(alGetError() != AL_NO_ERROR)
+    if(length < 0)
     {
-        SetError("Buffer creation failed");
+        SetError("Invalid data length");
         return AL_NONE;
     }
 
-    if(alureBufferDataFromMemory(fdata, length, buf) == AL_FALSE)
+    ALCcontext *ctx = alcGetCurrentContext();
+    if(!ctx)
     {
-        alDeleteBuffers(1, &buf);
-        alGetError();
-        buf = AL_NONE;
+        SetError("No active context");
+        return AL_NONE;
     }
 
-    return buf;
+    SharedBufferKey key;
+    key.device = alcGetContextsDevice(ctx);
+    key.length = length;
+    key.hash = HashBytes(fdata, length);
+    key.check = CheckBytes(fdata, length);
+
+    MemDataInfo memData;
+    memData.Data = fdata;
+    memData.Length = length;
+    memData.Pos = 0;
+
+    return get_shared_buffer(memData, std::string(), key);
 }
 
-/* Function: alureBufferDataFromFile
+/* Function: alureReleaseSharedBuffer
  *
- * Loads the given file into an existing OpenAL buffer object. The previous
- * contents of the buffer are replaced. Requires an active context.
+ * Releases a reference to a buffer returned by
+ * <alureCreateSharedBufferFromFile> or <alureCreateSharedBufferFromMemory>.
+ * The buffer is deleted when its last reference is released, so it must not
+ * be in use by any source by then. Requires an active context on the
+ * buffer's device.
  *
  * Returns:
- * AL_FALSE on error.
+ * AL_FALSE on error, or if the buffer isn't a shared buffer.
+ *
+ * *Version Added*: 1.3
  *
  * See Also:
- * <alureCreateBufferFromFile>
+ * <alureCreateSharedBufferFromFile>, <alureCreateSharedBufferFromMemory>
  */
-ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromFile(const ALchar *fname, ALuint buffer)
+ALURE_API ALboolean ALURE_APIENTRY alureReleaseSharedBuffer(ALuint buffer)
 {
-    if(alGetError() != AL_NO_ERROR)
+    ALCcontext *ctx = alcGetCurrentContext();
+    if(!ctx)
     {
-        SetError("Existing OpenAL error");
+        SetError("No active context");
         return AL_FALSE;
     }
+    ALCdevice *device = alcGetContextsDevice(ctx);
 
-    if(!buffer || !alIsBuffer(buffer))
+    EnterCriticalSection(&cs_BufferCache);
+    std::map<std::pair<ALCdevice*,ALuint>,SharedBufferMap::iterator>::iterator i;
+    i = SharedBufferIndex.find(std::make_pair(device, buffer));
+    if(i == SharedBufferIndex.end())
     {
-        SetError("Invalid buffer ID");
-        return false;
+        LeaveCriticalSection(&cs_BufferCache);
+        SetError("Not a shared buffer");
+        return AL_FALSE;
     }
 
-    if(load_stream(create_stream(fname), buffer) == false)
-        return AL_FALSE;
+    if(--i->second->second.refs == 0)
+    {
+        SharedBufferMemoryUsed -= i->second->second.size;
+        SharedBuffers.erase(i->second);
+        SharedBufferIndex.erase(i);
+        alDeleteBuffers(1, &buffer);
+        if(alGetError() != AL_NO_ERROR)
+        {
+            LeaveCriticalSection(&cs_BufferCache);
+            SetError("Buffer deletion failed");
+            return AL_FALSE;
+        }
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+
     return AL_TRUE;
 }
 
-/* Function: alureBufferDataFromMemory
+/* Function: alureSetMemoryBudget
  *
- * Loads a file image from memory into an existing OpenAL buffer object,
- * similar to alureBufferDataFromFile. Requires an active context.
+ * Sets a cap on the memory alure keeps for decoded audio. This covers the
+ * buffer cache (see <alureSetBufferCacheSize>), the chunk storage and memory
+ * copies of streams, shared buffers (see <alureCreateSharedBufferFromFile>),
+ * and buffers registered with <alureRegisterEvictableBuffer>. When the cap is
+ * exceeded, cached data is dropped first, then the least recently used
+ * evictable buffers on the current device are evicted. If that isn't enough,
+ * the callback is called. A budget of 0 (the default) disables the cap.
+ * Nothing is evicted if an OpenAL error is already pending, since eviction
+ * has to check for errors itself. Data decoded by async loads is counted when
+ * <alureUpdate> makes its buffer.
+ *
+ * Parameters:
+ * budget - The cap, in bytes.
+ * callback - Called with the given userdata, the bytes in use, and the budget
+ *            when use stays over budget. It is called from whichever alure
+ *            function caused the excess, and may be NULL.
+ * userdata - An opaque user pointer passed to the callback.
  *
  * Returns:
  * AL_FALSE on error.
  *
+ * *Version Added*: 1.3
+ *
  * See Also:
- * <alureCreateBufferFromMemory>
+ * <alureGetMemoryUsage>, <alureRegisterEvictableBuffer>
  */
-ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemory(const ALubyte *fdata, ALsizei length, ALuint buffer)
+ALURE_API ALboolean ALURE_APIENTRY alureSetMemoryBudget(alureUInt64 budget,
+    void (*callback)(void *userdata, alureUInt64 used, alureUInt64 budget), void *userdata)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    MemoryBudget = budget;
+    MemoryPressureCallback = callback;
+    MemoryPressureUserdata = userdata;
+    LeaveCriticalSection(&cs_BufferCache);
+
+    enforce_budget();
+    return AL_TRUE;
+}
+
+/* Function: alureGetMemoryUsage
+ *
+ * Returns the number of bytes counted against the memory budget. See
+ * <alureSetMemoryBudget>.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureSetMemoryBudget>
+ */
+ALURE_API alureUInt64 ALURE_APIENTRY alureGetMemoryUsage(void)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    alureUInt64 used = get_memory_used();
+    LeaveCriticalSection(&cs_BufferCache);
+    return used;
+}
+
+/* Function: alureRegisterEvictableBuffer
+ *
+ * Registers a buffer holding the given file's sound as evictable. Evictable
+ * buffers count against the memory budget, and the least recently used ones
+ * have their data dropped when over budget (see <alureSetMemoryBudget>).
+ * Buffers attached to a source can't be evicted. Buffers are marked as used
+ * by <alurePlaySource> and <alureTouchBuffer>, and an evicted buffer must be
+ * reloaded with <alureTouchBuffer> before it is attached to a source again.
+ * Requires an active context.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureUnregisterEvictableBuffer>, <alureTouchBuffer>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureRegisterEvictableBuffer(ALuint buffer, const ALchar *fname)
 {
     if(alGetError() != AL_NO_ERROR)
     {
@@ -216,23 +2014,200 @@ ALURE_API ALboolean ALURE_APIENTRY alureBufferDataFromMemory(const ALubyte *fdat
     if(!buffer || !alIsBuffer(buffer))
     {
         SetError("Invalid buffer ID");
-        return false;
+        return AL_FALSE;
+    }
+    if(!fname)
+    {
+        SetError("Invalid filename");
+        return AL_FALSE;
     }
 
-    if(length < 0)
+    ALint size = 0;
+    alGetBufferi(buffer, AL_SIZE, &size);
+
+    EnterCriticalSection(&cs_BufferCache);
+    EvictableList::iterator i = find_evictable(buffer);
+    if(i != EvictableBuffers.end())
     {
-        SetError("Invalid data length");
+        EvictableMemoryUsed -= i->size;
+        EvictableIndex.erase(std::make_pair(i->device, i->buffer));
+        EvictableBuffers.erase(i);
+    }
+
+    EvictableBuffer ent;
+    ent.buffer = buffer;
+    ent.device = get_current_device();
+    ent.fname = fname;
+    ent.size = std::max(size, 0);
+    ent.loaded = (size > 0);
+    EvictableBuffers.push_front(ent);
+    EvictableIndex[std::make_pair(ent.device, buffer)] = EvictableBuffers.begin();
+    EvictableMemoryUsed += ent.size;
+    LeaveCriticalSection(&cs_BufferCache);
+
+    enforce_budget(buffer);
+    return AL_TRUE;
+}
+
+/* Function: alureUnregisterEvictableBuffer
+ *
+ * Stops managing a buffer registered with <alureRegisterEvictableBuffer>. The
+ * buffer is left as it is, evicted or not. Requires an active context.
+ *
+ * Returns:
+ * AL_FALSE on error, or if the buffer isn't registered.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureRegisterEvictableBuffer>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureUnregisterEvictableBuffer(ALuint buffer)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    EvictableList::iterator i = find_evictable(buffer);
+    if(i == EvictableBuffers.end())
+    {
+        LeaveCriticalSection(&cs_BufferCache);
+        SetError("Not an evictable buffer");
         return AL_FALSE;
     }
 
-    MemDataInfo memData;
-    memData.Data = fdata;
-    memData.Length = length;
-    memData.Pos = 0;
+    EvictableMemoryUsed -= i->size;
+    EvictableIndex.erase(std::make_pair(i->device, i->buffer));
+    EvictableBuffers.erase(i);
+    LeaveCriticalSection(&cs_BufferCache);
+
+    return AL_TRUE;
+}
+
+/* Function: alureTouchBuffer
+ *
+ * Marks a buffer registered with <alureRegisterEvictableBuffer> as the most
+ * recently used one, and reloads it from its file if it was evicted. The
+ * buffer must not be attached to a source while it's reloaded. Requires an
+ * active context.
+ *
+ * Returns:
+ * AL_FALSE on error, or if the buffer isn't registered.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureRegisterEvictableBuffer>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureTouchBuffer(ALuint buffer)
+{
+    EnterCriticalSection(&cs_BufferCache);
+    EvictableList::iterator i = find_evictable(buffer);
+    if(i == EvictableBuffers.end())
+    {
+        LeaveCriticalSection(&cs_BufferCache);
+        SetError("Not an evictable buffer");
+        return AL_FALSE;
+    }
+    EvictableBuffers.splice(EvictableBuffers.begin(), EvictableBuffers, i);
+    if(i->loaded)
+    {
+        LeaveCriticalSection(&cs_BufferCache);
+        return AL_TRUE;
+    }
+    std::string fname = i->fname;
+    LeaveCriticalSection(&cs_BufferCache);
 
-    if(load_stream(create_stream(memData), buffer) == false)
+    if(alureBufferDataFromFile(fname.c_str(), buffer) == AL_FALSE)
         return AL_FALSE;
+
+    ALint size = 0;
+    alGetBufferi(buffer, AL_SIZE, &size);
+
+    EnterCriticalSection(&cs_BufferCache);
+    i = find_evictable(buffer);
+    if(i != EvictableBuffers.end() && !i->loaded)
+    {
+        i->size = std::max(size, 0);
+        i->loaded = true;
+        EvictableMemoryUsed += i->size;
+    }
+    LeaveCriticalSection(&cs_BufferCache);
+
+    enforce_budget(buffer);
     return AL_TRUE;
 }
 
+/* Function: alureCreateBuffersFromFiles
+ *
+ * Loads the given files into new OpenAL buffer objects, similar to calling
+ * <alureCreateBufferFromFile> for each one. The files are decoded in parallel
+ * on a pool of worker threads sized to the number of processors, while the
+ * calling thread uploads the decoded data to OpenAL. The new buffer IDs are
+ * stored in 'bufs', with AL_NONE for each file that failed to load. Requires
+ * an active context.
+ *
+ * Returns:
+ * The number of files successfully loaded, or -1 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBuffersFromMemory>, <alureCreateBufferFromFile>
+ */
+ALURE_API ALsizei ALURE_APIENTRY alureCreateBuffersFromFiles(const ALchar *const *fnames, ALsizei count, ALuint *bufs)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return -1;
+    }
+
+    if(count < 0)
+    {
+        SetError("Invalid file count");
+        return -1;
+    }
+    if(count == 0)
+        return 0;
+
+    BatchLoad batch(count);
+    batch.fnames = fnames;
+    return load_batch(batch, bufs);
+}
+
+/* Function: alureCreateBuffersFromMemory
+ *
+ * Loads the given file images from memory into new OpenAL buffer objects,
+ * similar to <alureCreateBuffersFromFiles>. The new buffer IDs are stored in
+ * 'bufs', with AL_NONE for each image that failed to load. Requires an active
+ * context.
+ *
+ * Returns:
+ * The number of images successfully loaded, or -1 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureCreateBuffersFromFiles>, <alureCreateBufferFromMemory>
+ */
+ALURE_API ALsizei ALURE_APIENTRY alureCreateBuffersFromMemory(const ALubyte *const *fdata, const ALsizei *lengths, ALsizei count, ALuint *bufs)
+{
+    if(alGetError() != AL_NO_ERROR)
+    {
+        SetError("Existing OpenAL error");
+        return -1;
+    }
+
+    if(count < 0)
+    {
+        SetError("Invalid data count");
+        return -1;
+    }
+    if(count == 0)
+        return 0;
+
+    BatchLoad batch(count);
+    batch.fdata = fdata;
+    batch.lengths = lengths;
+    return load_batch(batch, bufs);
+}
+
 } // extern "C"
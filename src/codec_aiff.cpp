@@ -46,6 +46,15 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 12 && memcmp(data, "FORM", 4) == 0 && memcmp(data+8, "AIFF", 4) == 0)
+            return Decoder::Match;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "aif,aiff"; }
+
     virtual bool IsValid()
     { return (dataStart > 0 && format != AL_NONE); }
 
@@ -60,9 +69,7 @@ public:
     virtual ALuint GetData(ALubyte *data, ALuint bytes)
     {
         std::streamsize rem = ((remLen >= bytes) ? bytes : remLen) / blockAlign;
-        fstream->read(reinterpret_cast<char*>(data), rem*blockAlign);
-
-        std::streamsize got = fstream->gcount();
+        std::streamsize got = src.Read(data, rem*blockAlign);
         remLen -= got;
         got -= got%blockAlign;
 
@@ -86,10 +93,33 @@ public:
         return got;
     }
 
+    virtual const ALubyte *GetDataPtr(ALuint *bytes)
+    {
+        // Samples need to be in the native byte order to be used as-is
+        if(LittleEndian && sampleSize > 1)
+            return NULL;
+
+        alureUInt64 memLength;
+        const ALubyte *mem = GetStreamMemory(fstream, &memLength);
+        if(!mem) return NULL;
+
+        alureUInt64 pos = dataStart + (dataLen-remLen);
+        if(pos > memLength) return NULL;
+
+        ALuint got = std::min<alureUInt64>(std::min<alureUInt64>(remLen, memLength-pos), *bytes);
+        got -= got%blockAlign;
+
+        if(src.Seek(pos+got, SEEK_SET) < 0)
+            return NULL;
+        remLen -= got;
+
+        *bytes = got;
+        return mem+pos;
+    }
+
     virtual bool Rewind()
     {
-        fstream->clear();
-        if(fstream->seekg(dataStart))
+        if(src.Seek(dataStart, SEEK_SET) >= 0)
         {
             remLen = dataLen;
             return true;
@@ -99,6 +129,27 @@ public:
         return false;
     }
 
+    virtual bool Seek(alureUInt64 frame)
+    {
+        alureUInt64 offset = frame / DetectCompressionRate(format) * blockAlign;
+        offset = std::min<alureUInt64>(offset, dataLen);
+
+        if(src.Seek(dataStart + offset, SEEK_SET) >= 0)
+        {
+            remLen = dataLen - offset;
+            return true;
+        }
+
+        SetError("Seek failed");
+        return false;
+    }
+
+    virtual alureInt64 Tell()
+    {
+        alureInt64 pos = dataLen - remLen;
+        return pos / blockAlign * DetectCompressionRate(format);
+    }
+
     virtual alureInt64 GetLength()
     {
         alureInt64 ret = dataLen;
@@ -111,32 +162,32 @@ public:
         ALubyte buffer[25];
         int length;
 
-        if(!fstream->read(reinterpret_cast<char*>(buffer), 12) ||
+        if(src.Read(buffer, 12) != 12 ||
            memcmp(buffer, "FORM", 4) != 0 || memcmp(buffer+8, "AIFF", 4) != 0)
             return;
 
         while(!dataStart || format == AL_NONE)
         {
             char tag[4];
-            if(!fstream->read(tag, 4))
+            if(src.Read(tag, 4) != 4)
                 break;
 
             /* read chunk length */
-            length = read_be32(fstream);
+            length = read_be32(src);
 
             if(memcmp(tag, "COMM", 4) == 0 && length >= 18)
             {
                 /* mono or stereo data */
-                channels = read_be16(fstream);
+                channels = read_be16(src);
 
                 /* number of sample frames */
-                fstream->ignore(4);
+                src.Skip(4);
 
                 /* bits per sample */
-                sampleSize = read_be16(fstream) / 8;
+                sampleSize = read_be16(src) / 8;
 
                 /* sample frequency */
-                samplerate = read_be80extended(fstream);
+                samplerate = read_be80extended(src);
 
                 /* block alignment */
                 blockAlign = channels * sampleSize;
@@ -147,16 +198,17 @@ public:
             }
             else if(memcmp(tag, "SSND", 4) == 0)
             {
-                dataStart = fstream->tellg();
+                dataStart = src.Tell();
                 dataStart += 8;
                 dataLen = remLen = length - 8;
             }
 
-            fstream->seekg(length, std::ios_base::cur);
+            if(!src.Skip(length))
+                break;
         }
 
         if(dataStart > 0 && format != AL_NONE)
-            fstream->seekg(dataStart);
+            src.Seek(dataStart, SEEK_SET);
     }
 
     virtual ~aiffStream()
@@ -48,6 +48,19 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 4 && memcmp(data, "IMPM", 4) == 0) /* IT */
+            return Decoder::Match;
+        if(len >= 17 && memcmp(data, "Extended Module: ", 17) == 0) /* XM */
+            return Decoder::Match;
+        if(len >= 48 && memcmp(data+44, "SCRM", 4) == 0) /* S3M */
+            return Decoder::Match;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "it,xm,s3m"; }
+
     virtual bool IsValid()
     { return renderer != NULL; }
 
@@ -170,8 +183,7 @@ public:
                 dumbfile_close(dumbFile);
                 dumbFile = NULL;
             }
-            fstream->clear();
-            fstream->seekg(0);
+            src.Seek(0, SEEK_SET);
         }
     }
 
@@ -194,31 +206,22 @@ private:
     // DUMBFILE iostream callbacks
     static int skip(void *user_data, long offset)
     {
-        std::istream *stream = static_cast<dumbStream*>(user_data)->fstream;
-        stream->clear();
-
-        if(stream->seekg(offset, std::ios_base::cur))
-            return 0;
-        return -1;
+        ByteSource &src = static_cast<dumbStream*>(user_data)->src;
+        return src.Skip(offset) ? 0 : -1;
     }
 
     static long read(char *ptr, long size, void *user_data)
     {
-        std::istream *stream = static_cast<dumbStream*>(user_data)->fstream;
-        stream->clear();
-
-        stream->read(ptr, size);
-        return stream->gcount();
+        ByteSource &src = static_cast<dumbStream*>(user_data)->src;
+        return src.Read(ptr, size);
     }
 
     static int read_char(void *user_data)
     {
-        std::istream *stream = static_cast<dumbStream*>(user_data)->fstream;
-        stream->clear();
+        ByteSource &src = static_cast<dumbStream*>(user_data)->src;
 
         unsigned char ret;
-        stream->read(reinterpret_cast<char*>(&ret), 1);
-        if(stream->gcount() > 0)
+        if(src.Read(&ret, 1) > 0)
             return ret;
         return -1;
     }
@@ -47,10 +47,24 @@ private:
     ALuint outMax;
     ALuint outLen;
 
+    alureUInt64 samplePos;
+
 public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 4 && memcmp(data, "fLaC", 4) == 0)
+            return Decoder::Match;
+        // libFLAC skips ID3v2 tags, so the stream marker may come later
+        if(len >= 3 && memcmp(data, "ID3", 3) == 0)
+            return Decoder::MaybeMatch;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "flac"; }
+
     virtual bool IsValid()
     { return flacFile != NULL; }
 
@@ -83,14 +97,24 @@ public:
                 break;
         }
 
+        samplePos += outLen / blockAlign;
         return outLen;
     }
 
     virtual bool Rewind()
     {
-        if(FLAC__stream_decoder_seek_absolute(flacFile, 0) != false)
+        return Seek(0);
+    }
+
+    virtual bool Seek(alureUInt64 frame)
+    {
+        // Nothing can be written out while seeking, so the decoded frame at
+        // the new position ends up in initialData
+        initialData.clear();
+        outLen = outMax = 0;
+        if(FLAC__stream_decoder_seek_absolute(flacFile, frame) != false)
         {
-            initialData.clear();
+            samplePos = frame;
             return true;
         }
 
@@ -98,6 +122,11 @@ public:
         return false;
     }
 
+    virtual alureInt64 Tell()
+    {
+        return samplePos;
+    }
+
     virtual alureInt64 GetLength()
     {
         return FLAC__stream_decoder_get_total_samples(flacFile);
@@ -105,7 +134,7 @@ public:
 
     flacStream(std::istream *_fstream)
       : alureStream(_fstream), flacFile(NULL), format(AL_NONE), samplerate(0),
-        blockAlign(0), useFloat(AL_FALSE)
+        blockAlign(0), useFloat(AL_FALSE), samplePos(0)
     {
         flacFile = FLAC__stream_decoder_new();
         if(flacFile)
@@ -278,56 +307,49 @@ private:
 
     static FLAC__StreamDecoderReadStatus ReadCallback(const FLAC__StreamDecoder*, FLAC__byte buffer[], size_t *bytes, void *client_data)
     {
-        std::istream *stream = static_cast<flacStream*>(client_data)->fstream;
-        stream->clear();
+        ByteSource &src = static_cast<flacStream*>(client_data)->src;
 
         if(*bytes <= 0)
             return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
 
-        stream->read(reinterpret_cast<char*>(buffer), *bytes);
-        *bytes = stream->gcount();
-        if(*bytes == 0 && stream->eof())
+        *bytes = src.Read(buffer, *bytes);
+        if(*bytes == 0 && src.Eof())
             return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
 
         return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
     }
     static FLAC__StreamDecoderSeekStatus SeekCallback(const FLAC__StreamDecoder*, FLAC__uint64 absolute_byte_offset, void *client_data)
     {
-        std::istream *stream = static_cast<flacStream*>(client_data)->fstream;
-        stream->clear();
+        ByteSource &src = static_cast<flacStream*>(client_data)->src;
 
-        if(!stream->seekg(absolute_byte_offset))
+        if(src.Seek(absolute_byte_offset, SEEK_SET) < 0)
             return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
         return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
     }
     static FLAC__StreamDecoderTellStatus TellCallback(const FLAC__StreamDecoder*, FLAC__uint64 *absolute_byte_offset, void *client_data)
     {
-        std::istream *stream = static_cast<flacStream*>(client_data)->fstream;
-        stream->clear();
+        ByteSource &src = static_cast<flacStream*>(client_data)->src;
 
-        *absolute_byte_offset = stream->tellg();
+        alureInt64 pos = src.Tell();
+        if(pos < 0)
+            return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
+        *absolute_byte_offset = pos;
         return FLAC__STREAM_DECODER_TELL_STATUS_OK;
     }
     static FLAC__StreamDecoderLengthStatus LengthCallback(const FLAC__StreamDecoder*, FLAC__uint64 *stream_length, void *client_data)
     {
-        std::istream *stream = static_cast<flacStream*>(client_data)->fstream;
-        stream->clear();
-
-        std::streampos pos = stream->tellg();
-        if(stream->seekg(0, std::ios_base::end))
-        {
-            *stream_length = stream->tellg();
-            stream->seekg(pos);
-        }
+        ByteSource &src = static_cast<flacStream*>(client_data)->src;
 
-        if(!stream->good())
+        alureInt64 len = src.Size();
+        if(len < 0)
             return FLAC__STREAM_DECODER_LENGTH_STATUS_ERROR;
+        *stream_length = len;
         return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
     }
     static FLAC__bool EofCallback(const FLAC__StreamDecoder*, void *client_data)
     {
-        std::istream *stream = static_cast<flacStream*>(client_data)->fstream;
-        return (stream->eof()) ? true : false;
+        ByteSource &src = static_cast<flacStream*>(client_data)->src;
+        return (src.Eof()) ? true : false;
     }
 };
 // Priority = 1, so it's preferred over libsndfile
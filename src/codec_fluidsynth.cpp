@@ -111,6 +111,15 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 4 && memcmp(data, "MThd", 4) == 0)
+            return Decoder::Match;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "mid,midi"; }
+
     virtual bool IsValid()
     { return fluidSynth != NULL; }
 
@@ -288,34 +297,33 @@ public:
         if(device) alcGetIntegerv(device, ALC_FREQUENCY, 1, &sampleRate);
 
         char hdr[4];
-        if(!fstream->read(hdr, 4))
+        if(src.Read(hdr, 4) != 4)
             return;
 
         if(memcmp(hdr, "MThd", 4) == 0)
         {
-            ALuint len = read_be32(fstream);
+            ALuint len = read_be32(src);
             if(len != 6)
                 return;
 
-            int type = read_be16(fstream);
+            int type = read_be16(src);
             if(type != 0 && type != 1)
                 return;
 
-            ALuint numtracks = read_be16(fstream);
+            ALuint numtracks = read_be16(src);
 
-            Divisions = read_be16(fstream);
+            Divisions = read_be16(src);
             UpdateTempo(500000);
 
             Tracks.resize(numtracks);
             for(std::vector<MidiTrack>::iterator i = Tracks.begin(), end = Tracks.end();i != end;i++)
             {
-                if(!fstream->read(hdr, 4) || memcmp(hdr, "MTrk", 4) != 0)
+                if(src.Read(hdr, 4) != 4 || memcmp(hdr, "MTrk", 4) != 0)
                     return;
 
-                ALint len = read_be32(fstream);
+                ALint len = read_be32(src);
                 i->data.resize(len);
-                if(!fstream->read(reinterpret_cast<char*>(&i->data[0]), len) ||
-                   fstream->gcount() != len)
+                if(src.Read(&i->data[0], len) != size_t(len))
                     return;
 
                 unsigned long val = i->ReadVarLen();
@@ -42,6 +42,21 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 17 && memcmp(data, "Extended Module: ", 17) == 0) /* XM */
+            return Decoder::Match;
+        if(len >= 30 && data[28] == 0x1A && data[29] == 0x10) /* S3M */
+            return Decoder::Match;
+        if(len >= 4 && memcmp(data, "IMPM", 4) == 0) /* IT */
+            return Decoder::Match;
+        // MOD's tag is at offset 1080, and most other tracker formats have
+        // no usable signature, so let ModPlug have a go at them
+        return Decoder::MaybeMatch;
+    }
+    static const char *Extensions()
+    { return "xm,s3m,it,mod,669,mtm,stm,ult,med,okt,far,amf,dsm,mdl,ptm,psm,dmf,umx"; }
+
     virtual bool IsValid()
     { return modFile != NULL; }
 
@@ -69,9 +84,9 @@ public:
         ALuint total = 0;
         while(1)
         {
-            fstream->read(&data[total], data.size()-total);
-            if(fstream->gcount() == 0) break;
-            total += fstream->gcount();
+            size_t got = src.Read(&data[total], data.size()-total);
+            if(got == 0) break;
+            total += got;
             data.resize(total*2);
         }
         data.resize(total);
@@ -98,8 +113,7 @@ public:
         std::vector<char> data(1024);
         ALuint total = 0;
 
-        fstream->read(&data[total], data.size()-total);
-        total += fstream->gcount();
+        total += src.Read(&data[total], data.size()-total);
         if(total < 32) return;
 
         if(memcmp(&data[0], "Extended Module: ", 17) == 0 || /* XM */
@@ -109,9 +123,9 @@ public:
             while(1)
             {
                 data.resize(total*2);
-                fstream->read(&data[total], data.size()-total);
-                if(fstream->gcount() == 0) break;
-                total += fstream->gcount();
+                size_t got = src.Read(&data[total], data.size()-total);
+                if(got == 0) break;
+                total += got;
             }
             data.resize(total);
 
@@ -39,13 +39,26 @@ private:
     mpg123_handle *mp3File;
     long samplerate;
     int channels;
-    std::ios::pos_type dataStart;
-    std::ios::pos_type dataEnd;
+    alureInt64 dataStart;
+    alureInt64 dataEnd;
 
 public:
     static void Init() { mpg123_init(); }
     static void Deinit() { mpg123_exit(); }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        // MPEG audio frame sync, with valid version and layer bits
+        if(len >= 2 && data[0] == 0xff && (data[1]&0xe0) == 0xe0 &&
+           (data[1]&0x18) != 0x08 && (data[1]&0x06) != 0x00)
+            return Decoder::Match;
+        // Otherwise there may be ID3 tags, a RIFF header, or junk before the
+        // first frame
+        return Decoder::MaybeMatch;
+    }
+    static const char *Extensions()
+    { return "mp3,mp2,mp1,mpga"; }
+
     virtual bool IsValid()
     { return mp3File != NULL; }
 
@@ -88,6 +101,25 @@ public:
         return false;
     }
 
+    virtual bool Seek(alureUInt64 frame)
+    {
+        if(mpg123_seek(mp3File, frame, SEEK_SET) >= 0)
+            return true;
+        SetError("Seek failed");
+        return false;
+    }
+
+    virtual alureInt64 Tell()
+    {
+        off_t pos = mpg123_tell(mp3File);
+        if(pos < 0)
+        {
+            SetError("Tell failed");
+            return -1;
+        }
+        return pos;
+    }
+
     mp3Stream(std::istream *_fstream)
       : alureStream(_fstream), mp3File(NULL), dataStart(0), dataEnd(0)
     {
@@ -131,7 +163,7 @@ private:
         ALubyte buffer[25];
         int length;
 
-        if(!fstream->read(reinterpret_cast<char*>(buffer), 12))
+        if(src.Read(buffer, 12) != 12)
             return false;
 
         if(memcmp(buffer, "RIFF", 4) != 0 || memcmp(buffer+8, "WAVE", 4) != 0)
@@ -150,28 +182,24 @@ private:
                 dataStart += ((buffer[5]&0x10) ? 20 : 10);
             }
 
-            if(fstream->seekg(0, std::ios_base::end))
-            {
-                dataEnd = fstream->tellg();
-                fstream->seekg(dataStart);
-            }
-            return fstream->good();
+            dataEnd = src.Seek(0, SEEK_END);
+            return (dataEnd >= 0 && src.Seek(dataStart, SEEK_SET) >= 0);
         }
 
         int type = 0;
         while(1)
         {
             char tag[4];
-            if(!fstream->read(tag, 4))
+            if(src.Read(tag, 4) != 4)
                 break;
 
             /* read chunk length */
-            length = read_le32(fstream);
+            length = read_le32(src);
 
             if(memcmp(tag, "fmt ", 4) == 0 && length >= 16)
             {
                 /* Data type (should be 0x0050 or 0x0055 for MP3 data) */
-                type = read_le16(fstream);
+                type = read_le16(src);
                 if(type != 0x0050 && type != 0x0055)
                     break;
                 length -= 2;
@@ -182,14 +210,14 @@ private:
             {
                 if(type == 0x0050 || type == 0x0055)
                 {
-                    dataStart = fstream->tellg();
-                    dataEnd = dataStart;
-                    dataEnd += length;
-                    return fstream->good();
+                    dataStart = src.Tell();
+                    dataEnd = dataStart + length;
+                    return (dataStart >= 0);
                 }
             }
 
-            fstream->seekg(length, std::ios_base::cur);
+            if(!src.Skip(length))
+                break;
         }
 
         return false;
@@ -198,21 +226,17 @@ private:
     static ssize_t read(void *handle, void *buffer, size_t bytes)
     {
         mp3Stream *self = reinterpret_cast<mp3Stream*>(handle);
-        std::istream *fstream = self->fstream;
-        fstream->clear();
-
-        std::ios::pos_type rem = self->dataEnd - fstream->tellg();
+        ByteSource &src = self->src;
 
-        fstream->read(reinterpret_cast<char*>(buffer),
-                      std::min<std::ios::pos_type>(bytes, rem));
-        return fstream->gcount();
+        alureInt64 rem = self->dataEnd - src.Tell();
+        if(rem <= 0) return 0;
+        return src.Read(buffer, std::min<alureInt64>(bytes, rem));
     }
 
     static off_t lseek(void *handle, off_t offset, int whence)
     {
         mp3Stream *self = reinterpret_cast<mp3Stream*>(handle);
-        std::istream *fstream = self->fstream;
-        fstream->clear();
+        ByteSource &src = self->src;
 
         if(whence == SEEK_END)
         {
@@ -221,13 +245,13 @@ private:
                 offset = (self->dataEnd - self->dataStart) - offset;
         }
         else if(whence == SEEK_CUR)
-            offset = offset + fstream->tellg() - self->dataStart;
+            offset = offset + src.Tell() - self->dataStart;
         else if(whence != SEEK_SET)
             return -1;
 
-        if(offset >= 0 && std::ios::pos_type(offset) <= (self->dataEnd - self->dataStart))
+        if(offset >= 0 && offset <= (self->dataEnd - self->dataStart))
         {
-            if(fstream->seekg(std::ios::pos_type(offset) + self->dataStart))
+            if(src.Seek(offset + self->dataStart, SEEK_SET) >= 0)
                 return offset;
         }
 
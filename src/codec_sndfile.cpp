@@ -43,6 +43,14 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte*, size_t)
+    {
+        // libsndfile handles too many formats to check for here
+        return Decoder::MaybeMatch;
+    }
+    static const char *Extensions()
+    { return "wav,aif,aiff,aifc,au,snd,caf,w64,voc,flac,ogg"; }
+
     virtual bool IsValid()
     { return sndFile != NULL; }
 
@@ -71,6 +79,26 @@ public:
         return false;
     }
 
+    virtual bool Seek(alureUInt64 frame)
+    {
+        if(sf_seek(sndFile, frame, SEEK_SET) != -1)
+            return true;
+
+        SetError("Seek failed");
+        return false;
+    }
+
+    virtual alureInt64 Tell()
+    {
+        sf_count_t pos = sf_seek(sndFile, 0, SEEK_CUR);
+        if(pos < 0)
+        {
+            SetError("Tell failed");
+            return -1;
+        }
+        return pos;
+    }
+
     virtual alureInt64 GetLength()
     {
         if(sndInfo.frames == -1)
@@ -101,39 +129,20 @@ private:
     // libSndFile iostream callbacks
     static sf_count_t get_filelen(void *user_data)
     {
-        std::istream *stream = static_cast<sndStream*>(user_data)->fstream;
-        stream->clear();
-
-        std::streampos len = -1;
-        std::streampos pos = stream->tellg();
-        if(stream->seekg(0, std::ios_base::end))
-        {
-            len = stream->tellg();
-            stream->seekg(pos);
-        }
-
-        return len;
+        ByteSource &src = static_cast<sndStream*>(user_data)->src;
+        return src.Size();
     }
 
     static sf_count_t seek(sf_count_t offset, int whence, void *user_data)
     {
-        std::istream *stream = static_cast<sndStream*>(user_data)->fstream;
-        stream->clear();
-
-        if((whence == SEEK_CUR && stream->seekg(offset, std::ios_base::cur)) ||
-           (whence == SEEK_SET && stream->seekg(offset, std::ios_base::beg)) ||
-           (whence == SEEK_END && stream->seekg(offset, std::ios_base::end)))
-            return stream->tellg();
-
-        return -1;
+        ByteSource &src = static_cast<sndStream*>(user_data)->src;
+        return src.Seek(offset, whence);
     }
 
     static sf_count_t read(void *ptr, sf_count_t count, void *user_data)
     {
-        std::istream *stream = static_cast<sndStream*>(user_data)->fstream;
-        stream->clear();
-        stream->read(static_cast<char*>(ptr), count);
-        return stream->gcount();
+        ByteSource &src = static_cast<sndStream*>(user_data)->src;
+        return src.Read(ptr, count);
     }
 
     static sf_count_t write(const void*, sf_count_t, void*)
@@ -141,9 +150,8 @@ private:
 
     static sf_count_t tell(void *user_data)
     {
-        std::istream *stream = static_cast<sndStream*>(user_data)->fstream;
-        stream->clear();
-        return stream->tellg();
+        ByteSource &src = static_cast<sndStream*>(user_data)->src;
+        return src.Tell();
     }
 };
 static DecoderDecl<sndStream,0> sndStream_decoder;
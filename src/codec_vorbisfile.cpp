@@ -49,6 +49,20 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        // The first page of the stream should hold the Vorbis ID header
+        if(len >= 35 && memcmp(data, "OggS", 4) == 0 && memcmp(data+28, "\x01vorbis", 7) == 0)
+            return Decoder::Match;
+        // Skeleton or multiplexed streams may put the Vorbis headers on a
+        // later page
+        if(len >= 4 && memcmp(data, "OggS", 4) == 0)
+            return Decoder::MaybeMatch;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "ogg,oga"; }
+
     virtual bool IsValid()
     { return oggInfo != NULL; }
 
@@ -131,6 +145,26 @@ public:
         return false;
     }
 
+    virtual bool Seek(alureUInt64 frame)
+    {
+        if(ov_pcm_seek(&oggFile, frame) == 0)
+            return true;
+
+        SetError("Seek failed");
+        return false;
+    }
+
+    virtual alureInt64 Tell()
+    {
+        ogg_int64_t pos = ov_pcm_tell(&oggFile);
+        if(pos < 0)
+        {
+            SetError("Tell failed");
+            return -1;
+        }
+        return pos;
+    }
+
     virtual alureInt64 GetLength()
     {
         ogg_int64_t len = ov_pcm_total(&oggFile, oggBitstream);
@@ -164,36 +198,20 @@ private:
     // libVorbisFile iostream callbacks
     static int seek(void *user_data, ogg_int64_t offset, int whence)
     {
-        std::istream *stream = static_cast<oggStream*>(user_data)->fstream;
-        stream->clear();
-
-        if(whence == SEEK_CUR)
-            stream->seekg(offset, std::ios_base::cur);
-        else if(whence == SEEK_SET)
-            stream->seekg(offset, std::ios_base::beg);
-        else if(whence == SEEK_END)
-            stream->seekg(offset, std::ios_base::end);
-        else
-            return -1;
-
-        return stream->tellg();
+        ByteSource &src = static_cast<oggStream*>(user_data)->src;
+        return (src.Seek(offset, whence) < 0) ? -1 : 0;
     }
 
     static size_t read(void *ptr, size_t size, size_t nmemb, void *user_data)
     {
-        std::istream *stream = static_cast<oggStream*>(user_data)->fstream;
-        stream->clear();
-
-        stream->read(static_cast<char*>(ptr), nmemb*size);
-        size_t ret = stream->gcount();
-        return ret/size;
+        ByteSource &src = static_cast<oggStream*>(user_data)->src;
+        return src.Read(ptr, nmemb*size) / size;
     }
 
     static long tell(void *user_data)
     {
-        std::istream *stream = static_cast<oggStream*>(user_data)->fstream;
-        stream->clear();
-        return stream->tellg();
+        ByteSource &src = static_cast<oggStream*>(user_data)->src;
+        return src.Tell();
     }
 
     static int close(void*)
@@ -46,6 +46,15 @@ public:
     static void Init() { }
     static void Deinit() { }
 
+    static Decoder::ProbeResult Probe(const ALubyte *data, size_t len)
+    {
+        if(len >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data+8, "WAVE", 4) == 0)
+            return Decoder::Match;
+        return Decoder::NoMatch;
+    }
+    static const char *Extensions()
+    { return "wav,wave"; }
+
     virtual bool IsValid()
     { return (dataStart > 0 && format != AL_NONE); }
 
@@ -60,9 +69,7 @@ public:
     virtual ALuint GetData(ALubyte *data, ALuint bytes)
     {
         std::streamsize rem = ((remLen >= bytes) ? bytes : remLen) / blockAlign;
-        fstream->read(reinterpret_cast<char*>(data), rem*blockAlign);
-
-        std::streamsize got = fstream->gcount();
+        std::streamsize got = src.Read(data, rem*blockAlign);
         remLen -= got;
         got -= got%blockAlign;
 
@@ -93,10 +100,33 @@ public:
         return got;
     }
 
+    virtual const ALubyte *GetDataPtr(ALuint *bytes)
+    {
+        // Samples need to be in the native byte order to be used as-is
+        if(BigEndian && sampleSize > 8)
+            return NULL;
+
+        alureUInt64 memLength;
+        const ALubyte *mem = GetStreamMemory(fstream, &memLength);
+        if(!mem) return NULL;
+
+        alureUInt64 pos = dataStart + (dataLen-remLen);
+        if(pos > memLength) return NULL;
+
+        ALuint got = std::min<alureUInt64>(std::min<alureUInt64>(remLen, memLength-pos), *bytes);
+        got -= got%blockAlign;
+
+        if(src.Seek(pos+got, SEEK_SET) < 0)
+            return NULL;
+        remLen -= got;
+
+        *bytes = got;
+        return mem+pos;
+    }
+
     virtual bool Rewind()
     {
-        fstream->clear();
-        if(fstream->seekg(dataStart))
+        if(src.Seek(dataStart, SEEK_SET) >= 0)
         {
             remLen = dataLen;
             return true;
@@ -106,6 +136,27 @@ public:
         return false;
     }
 
+    virtual bool Seek(alureUInt64 frame)
+    {
+        alureUInt64 offset = frame / DetectCompressionRate(format) * blockAlign;
+        offset = std::min<alureUInt64>(offset, dataLen);
+
+        if(src.Seek(dataStart + offset, SEEK_SET) >= 0)
+        {
+            remLen = dataLen - offset;
+            return true;
+        }
+
+        SetError("Seek failed");
+        return false;
+    }
+
+    virtual alureInt64 Tell()
+    {
+        alureInt64 pos = dataLen - remLen;
+        return pos / blockAlign * DetectCompressionRate(format);
+    }
+
     virtual alureInt64 GetLength()
     {
         alureInt64 ret = dataLen;
@@ -118,44 +169,44 @@ public:
         ALubyte buffer[25];
         ALuint length;
 
-        if(!fstream->read(reinterpret_cast<char*>(buffer), 12) ||
+        if(src.Read(buffer, 12) != 12 ||
            memcmp(buffer, "RIFF", 4) != 0 || memcmp(buffer+8, "WAVE", 4) != 0)
             return;
 
         while(!dataStart || format == AL_NONE)
         {
             char tag[4];
-            if(!fstream->read(tag, 4))
+            if(src.Read(tag, 4) != 4)
                 break;
 
             /* read chunk length */
-            length = read_le32(fstream);
+            length = read_le32(src);
 
             if(memcmp(tag, "fmt ", 4) == 0 && length >= 16)
             {
                 /* Data type (should be 1 for PCM data, 3 for float PCM data,
                  * 7 for muLaw, and 17 for IMA4 data) */
-                int type = read_le16(fstream);
+                int type = read_le16(src);
                 if(type != 0x0001 && type != 0x0003 && type != 0x0007 &&
                    type != 0x0011)
                     break;
 
                 /* mono or stereo data */
-                channels = read_le16(fstream);
+                channels = read_le16(src);
 
                 /* sample frequency */
-                samplerate = read_le32(fstream);
+                samplerate = read_le32(src);
 
                 /* skip average bytes per second */
-                fstream->ignore(4);
+                src.Skip(4);
 
                 /* bytes per block */
-                blockAlign = read_le16(fstream);
+                blockAlign = read_le16(src);
                 if(blockAlign == 0)
                     break;
 
                 /* bits per sample */
-                sampleSize = read_le16(fstream);
+                sampleSize = read_le16(src);
 
                 length -= 16;
 
@@ -163,7 +214,7 @@ public:
                 ALuint extrabytes = 0;
                 if(length >= 2)
                 {
-                    extrabytes = read_le16(fstream);
+                    extrabytes = read_le16(src);
                     length -= 2;
                 }
                 extrabytes = std::min<ALuint>(extrabytes, length);
@@ -192,13 +243,14 @@ public:
                 }
                 else if(type == 0x0011 && extrabytes >= 2)
                 {
-                    int samples = read_le16(fstream);
+                    int samples = read_le16(src);
                     length -= 2;
 
                     /* AL_EXT_IMA4 only supports 36 bytes-per-channel block
-                     * alignment, which has 65 uncompressed sample frames */
+                     * alignment, which has 65 uncompressed sample frames.
+                     * Without a context, the file is only being described. */
                     if(blockAlign == 36*channels && samples == 65*channels &&
-                       alIsExtensionPresent("AL_EXT_IMA4"))
+                       (!alcGetCurrentContext() || alIsExtensionPresent("AL_EXT_IMA4")))
                     {
                          if(channels == 1)
                              format = AL_FORMAT_MONO_IMA4;
@@ -209,15 +261,16 @@ public:
             }
             else if(memcmp(tag, "data", 4) == 0)
             {
-                dataStart = fstream->tellg();
+                dataStart = src.Tell();
                 dataLen = remLen = length;
             }
 
-            fstream->seekg(length, std::ios_base::cur);
+            if(!src.Skip(length))
+                break;
         }
 
         if(dataStart > 0 && format != AL_NONE)
-            fstream->seekg(dataStart);
+            src.Seek(dataStart, SEEK_SET);
     }
 
     virtual ~wavStream()
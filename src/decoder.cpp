@@ -0,0 +1,456 @@
+/*
+ * ALURE  OpenAL utility library
+ * Copyright (c) 2009 by Chris Robinson.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Title: Decoding */
+
+#include "config.h"
+
+#include "main.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+#include <memory>
+
+
+enum SampleType {
+    SampleUByte,
+    SampleShort,
+    SampleFloat,
+    SampleDouble,
+    SampleMuLaw,
+    SampleIMA4,
+    SampleUnknown
+};
+
+static SampleType get_sample_type(ALenum format)
+{
+    switch(format)
+    {
+    case AL_FORMAT_MONO8:
+    case AL_FORMAT_STEREO8:
+    case AL_FORMAT_QUAD8:
+    case AL_FORMAT_QUAD8_LOKI:
+    case AL_FORMAT_REAR8:
+    case AL_FORMAT_51CHN8:
+    case AL_FORMAT_61CHN8:
+    case AL_FORMAT_71CHN8:
+        return SampleUByte;
+
+    case AL_FORMAT_MONO16:
+    case AL_FORMAT_STEREO16:
+    case AL_FORMAT_QUAD16:
+    case AL_FORMAT_QUAD16_LOKI:
+    case AL_FORMAT_REAR16:
+    case AL_FORMAT_51CHN16:
+    case AL_FORMAT_61CHN16:
+    case AL_FORMAT_71CHN16:
+        return SampleShort;
+
+    case AL_FORMAT_MONO_FLOAT32:
+    case AL_FORMAT_STEREO_FLOAT32:
+    case AL_FORMAT_QUAD32:
+    case AL_FORMAT_REAR32:
+    case AL_FORMAT_51CHN32:
+    case AL_FORMAT_61CHN32:
+    case AL_FORMAT_71CHN32:
+        return SampleFloat;
+
+    case AL_FORMAT_MONO_DOUBLE_EXT:
+    case AL_FORMAT_STEREO_DOUBLE_EXT:
+        return SampleDouble;
+
+    case AL_FORMAT_MONO_MULAW:
+    case AL_FORMAT_STEREO_MULAW:
+    case AL_FORMAT_QUAD_MULAW:
+    case AL_FORMAT_REAR_MULAW:
+    case AL_FORMAT_51CHN_MULAW:
+    case AL_FORMAT_61CHN_MULAW:
+    case AL_FORMAT_71CHN_MULAW:
+        return SampleMuLaw;
+
+    case AL_FORMAT_MONO_IMA4:
+    case AL_FORMAT_STEREO_IMA4:
+        return SampleIMA4;
+    }
+    return SampleUnknown;
+}
+
+static ALshort decode_mulaw(ALubyte val)
+{
+    val = ~val;
+    ALint t = (((val&0x0f)<<3) + 0x84) << ((val&0x70)>>4);
+    return (val&0x80) ? ALshort(0x84-t) : ALshort(t-0x84);
+}
+
+// Decodes one AL_EXT_IMA4 block: a 4-byte header per channel, then groups of
+// 4 bytes (8 samples) for each channel in turn. Writes 65 frames.
+static void decode_ima4(const ALubyte *src, ALuint channels, ALfloat *dst)
+{
+    static const ALint StepTable[89] = {
+            7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+           19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+           50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+          130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+          337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+          876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+         2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+         5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+    static const ALint IndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+    ALint sample[8], index[8];
+    for(ALuint c = 0;c < channels;c++)
+    {
+        sample[c] = ALshort(src[0] | (src[1]<<8));
+        index[c] = std::min<ALint>(src[2], 88);
+        dst[c] = sample[c] / 32768.0f;
+        src += 4;
+    }
+
+    for(ALuint group = 0;group < 8;group++)
+    {
+        for(ALuint c = 0;c < channels;c++)
+        {
+            for(ALuint i = 0;i < 8;i++)
+            {
+                ALint code = (src[i>>1] >> ((i&1)*4)) & 0x0f;
+                ALint step = StepTable[index[c]];
+                ALint diff = step >> 3;
+                if((code&1)) diff += step >> 2;
+                if((code&2)) diff += step >> 1;
+                if((code&4)) diff += step;
+                if((code&8)) diff = -diff;
+
+                sample[c] = std::max(-32768, std::min(sample[c]+diff, 32767));
+                index[c] = std::max(0, std::min(index[c]+IndexTable[code&7], 88));
+                dst[(1 + group*8 + i)*channels + c] = sample[c] / 32768.0f;
+            }
+            src += 4;
+        }
+    }
+}
+
+
+struct alureDecoder {
+    alureStream *stream;
+    ALuint channels;
+    ALuint blockAlign;
+    ALuint framesPerBlock;
+    SampleType srcType;
+    SampleType dstType;
+
+    // Raw data from the stream, and the samples converted from it that
+    // haven't been read yet
+    std::vector<ALubyte> raw;
+    std::vector<ALfloat> samples;
+    size_t samplesPos;
+
+    alureDecoder(alureStream *_stream)
+      : stream(_stream), channels(0), blockAlign(0), framesPerBlock(0),
+        srcType(SampleUnknown), dstType(SampleUnknown), samplesPos(0)
+    { }
+    ~alureDecoder()
+    {
+        std::istream *f = stream->fstream;
+        delete stream;
+        delete f;
+    }
+
+    // Decodes the next few blocks from the stream into samples. Returns false
+    // at the end of the stream.
+    bool Refill()
+    {
+        ALuint blocks = std::max<ALuint>(4096/framesPerBlock, 1);
+        raw.resize(blocks * blockAlign);
+        ALuint got = stream->GetData(&raw[0], raw.size());
+        got -= got%blockAlign;
+        if(got == 0)
+            return false;
+
+        ALuint count = got / blockAlign * framesPerBlock * channels;
+        samples.resize(count);
+        samplesPos = 0;
+
+        const ALubyte *src = &raw[0];
+        switch(srcType)
+        {
+        case SampleUByte:
+            for(ALuint i = 0;i < count;i++)
+                samples[i] = (src[i]-128) / 128.0f;
+            break;
+        case SampleShort:
+            for(ALuint i = 0;i < count;i++)
+            {
+                ALshort val;
+                memcpy(&val, src + i*sizeof(val), sizeof(val));
+                samples[i] = val / 32768.0f;
+            }
+            break;
+        case SampleFloat:
+            memcpy(&samples[0], src, count*sizeof(ALfloat));
+            break;
+        case SampleDouble:
+            for(ALuint i = 0;i < count;i++)
+            {
+                ALdouble val;
+                memcpy(&val, src + i*sizeof(val), sizeof(val));
+                samples[i] = ALfloat(val);
+            }
+            break;
+        case SampleMuLaw:
+            for(ALuint i = 0;i < count;i++)
+                samples[i] = decode_mulaw(src[i]) / 32768.0f;
+            break;
+        case SampleIMA4:
+            for(ALuint i = 0;i < got/blockAlign;i++)
+                decode_ima4(src + i*blockAlign, channels, &samples[i*65*channels]);
+            break;
+        case SampleUnknown:
+            return false;
+        }
+        return true;
+    }
+
+    // Writes count samples from the pending ones to dst, in the requested type
+    void Convert(ALubyte *dst, size_t count)
+    {
+        const ALfloat *src = &samples[samplesPos];
+        switch(dstType)
+        {
+        case SampleUByte:
+            for(size_t i = 0;i < count;i++)
+            {
+                ALint val = ALint(src[i]*128.0f) + 128;
+                dst[i] = ALubyte(std::max(0, std::min(val, 255)));
+            }
+            break;
+        case SampleShort:
+            for(size_t i = 0;i < count;i++)
+            {
+                ALint val = ALint(src[i]*32768.0f);
+                ALshort s = ALshort(std::max(-32768, std::min(val, 32767)));
+                memcpy(dst + i*sizeof(s), &s, sizeof(s));
+            }
+            break;
+        case SampleFloat:
+            memcpy(dst, src, count*sizeof(ALfloat));
+            break;
+        default:
+            break;
+        }
+        samplesPos += count;
+    }
+
+    ALsizei Read(ALubyte *dst, ALsizei frames)
+    {
+        ALuint frameSize = channels * ((dstType == SampleUByte) ? 1 :
+                                       (dstType == SampleShort) ? 2 : 4);
+
+        // Samples already in the requested type are read straight from the
+        // stream
+        if(srcType == dstType && samplesPos == samples.size())
+        {
+            ALsizei done = 0;
+            while(done < frames)
+            {
+                ALuint todo = std::min<alureUInt64>(frames-done, 0x7fffffff/frameSize) * frameSize;
+                ALuint got = stream->GetData(dst + alureUInt64(done)*frameSize, todo);
+                got -= got%frameSize;
+                if(got == 0)
+                    break;
+                done += got / frameSize;
+            }
+            return done;
+        }
+
+        ALsizei done = 0;
+        while(done < frames)
+        {
+            if(samplesPos == samples.size() && !Refill())
+                break;
+            size_t todo = std::min<size_t>((samples.size()-samplesPos) / channels,
+                                           frames-done);
+            Convert(dst + alureUInt64(done)*frameSize, todo*channels);
+            done += todo;
+        }
+        return done;
+    }
+};
+
+// Sets up a decoder for the stream, and describes it in info if given
+static alureDecoder *open_decoder(alureStream *instream, ALuint bits, ALuint floatbits, alureProbeInfo *info)
+{
+    if(!instream)
+        return NULL;
+    std::auto_ptr<alureDecoder> decoder(new alureDecoder(instream));
+
+    if((bits == 8 || bits == 16) && floatbits == 0)
+        decoder->dstType = ((bits == 8) ? SampleUByte : SampleShort);
+    else if(bits == 0 && floatbits == 32)
+        decoder->dstType = SampleFloat;
+    else
+    {
+        SetError("Invalid sample type");
+        return NULL;
+    }
+
+    ALenum format;
+    ALuint freq, blockAlign;
+    if(!instream->GetFormat(&format, &freq, &blockAlign))
+    {
+        SetError("Could not get stream format");
+        return NULL;
+    }
+
+    static const ALuint SampleSizes[] = { 1, 2, 4, 8, 1, 36 };
+    decoder->srcType = get_sample_type(format);
+    decoder->channels = DetectChannels(format);
+    decoder->blockAlign = blockAlign;
+    decoder->framesPerBlock = ((decoder->srcType == SampleIMA4) ? 65 : 1);
+    if(decoder->srcType == SampleUnknown || decoder->channels == 0 ||
+       decoder->channels > 8 ||
+       blockAlign != SampleSizes[decoder->srcType]*decoder->channels)
+    {
+        SetError("Unsupported format");
+        return NULL;
+    }
+    if(freq == 0)
+    {
+        SetError("Invalid sample rate");
+        return NULL;
+    }
+
+    if(info)
+    {
+        info->format = format;
+        info->frequency = freq;
+        info->channels = decoder->channels;
+        info->frames = std::max<alureInt64>(instream->GetLength(), 0);
+    }
+    return decoder.release();
+}
+
+
+extern "C" {
+
+/* Function: alureOpenDecoder
+ *
+ * Opens a file for decoding without OpenAL. The decoded samples are read with
+ * <alureReadFrames> as interleaved PCM of the type given in the same way as
+ * <alureGetSampleFormat>: 'bits' of 8 (unsigned) or 16 (signed), or
+ * 'floatbits' of 32, with the other 0. No context is required, and separate
+ * decoders may be used from different threads at the same time. If 'info' is
+ * not NULL, it's filled in as with <alureProbeFile>; its channel count and
+ * frequency describe the frames that are read.
+ *
+ * Returns:
+ * A new decoder, or NULL on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureOpenDecoderFromMemory>, <alureReadFrames>, <alureCloseDecoder>
+ */
+ALURE_API alureDecoder* ALURE_APIENTRY alureOpenDecoder(const ALchar *fname, ALuint bits, ALuint floatbits, alureProbeInfo *info)
+{
+    return open_decoder(create_stream(fname), bits, floatbits, info);
+}
+
+/* Function: alureOpenDecoderFromMemory
+ *
+ * Opens a file image in memory for decoding, like <alureOpenDecoder>. The
+ * data is not copied, and must remain valid until the decoder is closed.
+ *
+ * Returns:
+ * A new decoder, or NULL on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureOpenDecoder>
+ */
+ALURE_API alureDecoder* ALURE_APIENTRY alureOpenDecoderFromMemory(const ALubyte *fdata, ALuint length, ALuint bits, ALuint floatbits, alureProbeInfo *info)
+{
+    MemDataInfo memData;
+    memData.Data = fdata;
+    memData.Length = length;
+    memData.Pos = 0;
+    return open_decoder(create_stream(memData), bits, floatbits, info);
+}
+
+/* Function: alureReadFrames
+ *
+ * Decodes up to the given number of sample frames into 'data', which must
+ * have room for them.
+ *
+ * Returns:
+ * The number of frames read, which is less than requested only at the end of
+ * the file, or -1 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureOpenDecoder>
+ */
+ALURE_API ALsizei ALURE_APIENTRY alureReadFrames(alureDecoder *decoder, ALvoid *data, ALsizei frames)
+{
+    if(!decoder)
+    {
+        SetError("Invalid decoder pointer");
+        return -1;
+    }
+    if(frames < 0 || (frames > 0 && !data))
+    {
+        SetError("Invalid frame count");
+        return -1;
+    }
+
+    return decoder->Read(static_cast<ALubyte*>(data), frames);
+}
+
+/* Function: alureCloseDecoder
+ *
+ * Closes a decoder opened with <alureOpenDecoder> or
+ * <alureOpenDecoderFromMemory>.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureCloseDecoder(alureDecoder *decoder)
+{
+    if(!decoder)
+    {
+        SetError("Invalid decoder pointer");
+        return AL_FALSE;
+    }
+
+    delete decoder;
+    return AL_TRUE;
+}
+
+} // extern "C"
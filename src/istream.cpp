@@ -32,13 +32,43 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+
+
+// Totals of the I/O done on the backend by files opened for decoding. Guarded
+// by cs_IOStats, as are the stats of each file.
+static alureIOStats IOTotals;
+
+// The access log callback given to files as they're opened
+static void (*IOLogFunc)(void*,const ALchar*,ALenum,alureInt64,alureInt64) = NULL;
+static void *IOLogData = NULL;
+
+static void add_io_stats(alureIOStats *stats, const alureIOStats &delta)
+{
+    stats->reads += delta.reads;
+    stats->bytesRead += delta.bytesRead;
+    stats->seeks += delta.seeks;
+    stats->seekDistance += delta.seekDistance;
+    stats->callbackTime += delta.callbackTime;
+}
 
 
-class MemStreamBuf : public std::streambuf {
+class MemStreamBuf : public SourceBuf {
     MemDataInfo memInfo;
 
+    // The file the memory is mapped from, if any
+    FileMapping mapping;
+
     virtual int_type underflow()
     {
         if(gptr() == egptr())
@@ -97,21 +127,548 @@ public:
         memInfo.Pos /= sizeof(char_type);
         memInfo.Length /= sizeof(char_type);
     }
-    virtual ~MemStreamBuf() { }
+    // Takes ownership of the mapping
+    MemStreamBuf(const FileMapping &map)
+      : mapping(map)
+    {
+        memInfo.Data = mapping.Data;
+        memInfo.Length = mapping.Length / sizeof(char_type);
+    }
+    virtual ~MemStreamBuf()
+    { UnmapFile(&mapping); }
+
+    const ALubyte *GetMemory(alureUInt64 *length) const
+    {
+        *length = memInfo.Length;
+        return memInfo.Data;
+    }
+
+    bool TakeMapping(FileMapping *map)
+    {
+        if(!mapping.Data)
+            return false;
+        *map = mapping;
+        mapping = FileMapping();
+        return true;
+    }
+};
+
+// Blocks of file data shared by the streams reading the same file. Blocks in
+// use by a stream are referenced, and unreferenced ones are kept in least
+// recently used order, to be dropped when the cache grows past FileCacheMax.
+// Guarded by cs_FileCache.
+static const size_t FileBlockSize = 65536;
+
+struct FileBlock {
+    std::string Key;
+    alureInt64 Start;
+    std::vector<char> Data;
+    ALuint RefCount;
+    FileBlock *LruPrev;
+    FileBlock *LruNext;
 };
+typedef std::map<std::pair<std::string,alureInt64>,FileBlock*> FileBlockMap;
+
+// Allocated when first used, since blocks are released by streams that may be
+// destroyed after static objects are gone
+static FileBlockMap *FileBlocks = NULL;
+static FileBlock *FileLruHead = NULL;
+static FileBlock *FileLruTail = NULL;
+static alureUInt64 FileCacheSize = 0;
+static alureUInt64 FileCacheMax = 0;
+// Changed along with the I/O routines, so files read through the old ones
+// aren't mistaken for the same names read through the new ones
+static ALuint FileCacheGeneration = 0;
+
+static void lru_unlink(FileBlock *block)
+{
+    if(block->LruPrev) block->LruPrev->LruNext = block->LruNext;
+    else FileLruHead = block->LruNext;
+    if(block->LruNext) block->LruNext->LruPrev = block->LruPrev;
+    else FileLruTail = block->LruPrev;
+    block->LruPrev = block->LruNext = NULL;
+}
+
+static void lru_append(FileBlock *block)
+{
+    block->LruPrev = FileLruTail;
+    block->LruNext = NULL;
+    if(FileLruTail) FileLruTail->LruNext = block;
+    else FileLruHead = block;
+    FileLruTail = block;
+}
+
+// Drops unreferenced blocks, oldest first, until the cache fits in the given
+// size. Must be called with cs_FileCache held.
+static void trim_file_cache(alureUInt64 size)
+{
+    while(FileCacheSize > size && FileLruHead)
+    {
+        FileBlock *block = FileLruHead;
+        lru_unlink(block);
+        FileBlocks->erase(std::make_pair(block->Key, block->Start));
+        FileCacheSize -= block->Data.size();
+        delete block;
+    }
+}
+
+// Gets a reference to the cached block, or NULL if it isn't cached
+static FileBlock *acquire_file_block(const std::string &key, alureInt64 start)
+{
+    FileBlock *block = NULL;
+    EnterCriticalSection(&cs_FileCache);
+    if(FileBlocks)
+    {
+        FileBlockMap::iterator i = FileBlocks->find(std::make_pair(key, start));
+        if(i != FileBlocks->end())
+        {
+            block = i->second;
+            if(block->RefCount++ == 0)
+                lru_unlink(block);
+        }
+    }
+    LeaveCriticalSection(&cs_FileCache);
+    return block;
+}
+
+static bool file_block_cached(const std::string &key, alureInt64 start)
+{
+    EnterCriticalSection(&cs_FileCache);
+    bool cached = (FileBlocks && FileBlocks->find(std::make_pair(key, start)) != FileBlocks->end());
+    LeaveCriticalSection(&cs_FileCache);
+    return cached;
+}
+
+// Adds a newly read, referenced block to the cache. If another stream cached
+// the same block first, the new one is deleted and the cached one returned.
+static FileBlock *insert_file_block(FileBlock *block)
+{
+    EnterCriticalSection(&cs_FileCache);
+    if(!FileBlocks)
+        FileBlocks = new FileBlockMap;
+    std::pair<FileBlockMap::iterator,bool> ins = FileBlocks->insert(
+        std::make_pair(std::make_pair(block->Key, block->Start), block));
+    if(!ins.second)
+    {
+        delete block;
+        block = ins.first->second;
+        if(block->RefCount++ == 0)
+            lru_unlink(block);
+    }
+    else
+    {
+        FileCacheSize += block->Data.size();
+        trim_file_cache(FileCacheMax);
+    }
+    LeaveCriticalSection(&cs_FileCache);
+    return block;
+}
+
+static void release_file_block(FileBlock *block)
+{
+    EnterCriticalSection(&cs_FileCache);
+    if(--block->RefCount == 0)
+    {
+        lru_append(block);
+        trim_file_cache(FileCacheMax);
+    }
+    LeaveCriticalSection(&cs_FileCache);
+}
+
+// Identifies a file for the file cache, by name, size, and modification time.
+// Files opened through user I/O callbacks can't be checked for changes, so
+// they aren't cached, as with the buffer cache. Returns an empty string if the
+// file can't be cached.
+static std::string get_file_cache_key(const char *filename)
+{
+    if(!UsingSTDIO)
+        return std::string();
+
+    struct stat st;
+    if(stat(filename, &st) != 0 || (st.st_mode&S_IFMT) != S_IFREG)
+        return std::string();
+
+    EnterCriticalSection(&cs_FileCache);
+    ALuint generation = FileCacheGeneration;
+    LeaveCriticalSection(&cs_FileCache);
+
+    std::ostringstream key;
+    key << generation << ':' << filename << '\0' << alureInt64(st.st_size) <<
+           ':' << alureInt64(st.st_mtime);
+    return key.str();
+}
 
-class FileStreamBuf : public std::streambuf {
+
+// Size of the background reads done for files opened for decoding, or 0 to
+// read synchronously. Guarded by cs_ReadAhead, like the rest of the readahead
+// state.
+static size_t ReadAheadSize = 0;
+
+class FileStreamBuf;
+static FileStreamBuf *ReadAheadQueue = NULL;
+static ThreadInfo *ReadAheadThread = NULL;
+static bool ReadAheadRunning = false;
+
+class FileStreamBuf : public SourceBuf {
     void *usrFile;
     UserFuncs fio;
 
-    char buffer[4096];
+    // I/O done on the backend, and where it's logged to
+    std::string name;
+    alureIOStats stats;
+    void (*logFunc)(void*,const ALchar*,ALenum,alureInt64,alureInt64);
+    void *logData;
+
+    // Data is read into buffers[current]. With readahead, the other buffer is
+    // filled in the background with the data that follows.
+    std::vector<char> buffers[2];
+    int current;
+
+    // With the file cache, data is read in whole blocks that are shared with
+    // other streams, and the window is the block being read from
+    std::string cacheKey;
+    FileBlock *block;
+
+    // The start of the file, kept while decoders probe it so each one can
+    // re-read the header without going back to the backend
+    static const size_t PrefixSize = 65536;
+    std::vector<char> prefix;
+    bool keepPrefix;
+    bool prefixLoaded;
+
+    // File offset of the start of the current window, and the backend's
+    // current offset
+    alureInt64 winStart;
+    alureInt64 filePos;
+
+    // Background read state. The queue link and state are guarded by
+    // cs_ReadAhead, and ioLock is held by the background thread while it uses
+    // the backend. ioLock is never taken after cs_ReadAhead.
+    enum {
+        AheadIdle,
+        AheadQueued,
+        AheadReading,
+        AheadDone
+    } aheadState;
+    alureInt64 aheadPos;
+    ALsizei aheadLen;
+    FileStreamBuf *aheadNext;
+    CRITICAL_SECTION ioLock;
+
+    alureInt64 GetPos() const
+    { return winStart + (gptr()-eback()); }
+
+    bool InPrefix() const
+    { return !prefix.empty() && eback() == &prefix[0]; }
+
+    // Adds I/O done on the backend to the file's stats and the totals, and
+    // logs it
+    void RecordIO(const alureIOStats &delta, ALenum event, alureInt64 offset, alureInt64 length)
+    {
+        EnterCriticalSection(&cs_IOStats);
+        add_io_stats(&stats, delta);
+        add_io_stats(&IOTotals, delta);
+        LeaveCriticalSection(&cs_IOStats);
+
+        if(logFunc)
+            logFunc(logData, name.c_str(), event, offset, length);
+    }
+
+    alureInt64 SeekBackend(alureInt64 offset, int whence)
+    {
+        alureUInt64 start = GetTimeUS();
+        alureInt64 pos = fio.seek(usrFile, offset, whence);
+
+        alureIOStats delta = alureIOStats();
+        delta.seeks = 1;
+        delta.callbackTime = GetTimeUS() - start;
+        if(pos >= 0)
+        {
+            delta.seekDistance = (pos > filePos) ? pos-filePos : filePos-pos;
+            filePos = pos;
+        }
+        RecordIO(delta, ALURE_IO_SEEK, pos, 0);
+        return pos;
+    }
+
+    ALsizei ReadCallback(char *buf, size_t len)
+    {
+        alureUInt64 start = GetTimeUS();
+        ALsizei amt = fio.read(usrFile, reinterpret_cast<ALubyte*>(buf), len);
+
+        alureIOStats delta = alureIOStats();
+        delta.reads = 1;
+        delta.bytesRead = std::max<ALsizei>(amt, 0);
+        delta.callbackTime = GetTimeUS() - start;
+        RecordIO(delta, ALURE_IO_READ, filePos, amt);
+        if(amt > 0) filePos += amt;
+        return amt;
+    }
+
+    ALsizei ReadBackend(alureInt64 pos, std::vector<char> &buf)
+    {
+        if(filePos != pos && SeekBackend(pos, SEEK_SET) != pos)
+            return 0;
+
+        ALsizei amt = ReadCallback(&buf[0], buf.size());
+        if(amt < 0) amt = 0;
+        return amt;
+    }
+
+    static ALuint ReadAheadWorker(ALvoid*)
+    {
+        EnterCriticalSection(&cs_ReadAhead);
+        while(ReadAheadQueue)
+        {
+            FileStreamBuf *self = ReadAheadQueue;
+            ReadAheadQueue = self->aheadNext;
+            self->aheadNext = NULL;
+            self->aheadState = AheadReading;
+            LeaveCriticalSection(&cs_ReadAhead);
+
+            EnterCriticalSection(&self->ioLock);
+            ALsizei amt = self->ReadBackend(self->aheadPos, self->buffers[self->current^1]);
+
+            EnterCriticalSection(&cs_ReadAhead);
+            self->aheadLen = amt;
+            self->aheadState = AheadDone;
+            LeaveCriticalSection(&self->ioLock);
+        }
+        ReadAheadRunning = false;
+        LeaveCriticalSection(&cs_ReadAhead);
+        return 0;
+    }
+
+    void QueueAhead(alureInt64 pos)
+    {
+        EnterCriticalSection(&cs_ReadAhead);
+        if(!ReadAheadRunning)
+        {
+            if(ReadAheadThread)
+                StopThread(ReadAheadThread);
+            ReadAheadThread = StartThread(ReadAheadWorker, NULL);
+            if(!ReadAheadThread)
+            {
+                // Just read synchronously
+                LeaveCriticalSection(&cs_ReadAhead);
+                return;
+            }
+            ReadAheadRunning = true;
+        }
+
+        aheadPos = pos;
+        aheadState = AheadQueued;
+        FileStreamBuf **tail = &ReadAheadQueue;
+        while(*tail)
+            tail = &(*tail)->aheadNext;
+        *tail = this;
+        LeaveCriticalSection(&cs_ReadAhead);
+    }
+
+    // Cancels the background read if it hasn't started yet, or waits for it
+    // to finish, so the backend is free to use
+    void SyncAhead()
+    {
+        if(buffers[1].empty())
+            return;
+
+        EnterCriticalSection(&cs_ReadAhead);
+        if(aheadState == AheadQueued)
+        {
+            FileStreamBuf **link = &ReadAheadQueue;
+            while(*link != this)
+                link = &(*link)->aheadNext;
+            *link = aheadNext;
+            aheadNext = NULL;
+            aheadState = AheadIdle;
+        }
+        bool reading = (aheadState == AheadReading);
+        LeaveCriticalSection(&cs_ReadAhead);
+
+        // The background thread holds ioLock until the read is done. It may
+        // not have taken it yet, so check again after getting it.
+        while(reading)
+        {
+            EnterCriticalSection(&ioLock);
+            LeaveCriticalSection(&ioLock);
+
+            EnterCriticalSection(&cs_ReadAhead);
+            reading = (aheadState == AheadReading);
+            LeaveCriticalSection(&cs_ReadAhead);
+        }
+    }
+
+    // Reads a whole block through the backend, stopping short only at the end
+    // of the file. Returns false on a read error.
+    bool ReadBlock(alureInt64 start, std::vector<char> &data)
+    {
+        data.resize(FileBlockSize);
+        if(filePos != start && SeekBackend(start, SEEK_SET) != start)
+            return false;
+
+        size_t total = 0;
+        while(total < data.size())
+        {
+            ALsizei amt = ReadCallback(&data[total], data.size()-total);
+            if(amt < 0) return false;
+            if(amt == 0) break;
+            total += amt;
+        }
+        data.resize(total);
+        return true;
+    }
+
+    // Gets the block starting at the given offset from the file cache,
+    // reading and adding it if it isn't there. Returns NULL on a read error.
+    FileBlock *GetBlock(alureInt64 start)
+    {
+        FileBlock *blk = acquire_file_block(cacheKey, start);
+        if(blk) return blk;
+
+        SyncAhead();
+
+        blk = new FileBlock;
+        blk->Key = cacheKey;
+        blk->Start = start;
+        blk->RefCount = 1;
+        blk->LruPrev = blk->LruNext = NULL;
+
+        // Readahead fills buffers[1] with the next block
+        if(aheadState == AheadDone && aheadPos == start &&
+           size_t(aheadLen) == FileBlockSize)
+        {
+            blk->Data.swap(buffers[1]);
+            buffers[1].resize(FileBlockSize);
+        }
+        else if(!ReadBlock(start, blk->Data))
+        {
+            aheadState = AheadIdle;
+            delete blk;
+            return NULL;
+        }
+        aheadState = AheadIdle;
+
+        blk = insert_file_block(blk);
+        if(!buffers[1].empty() && blk->Data.size() == FileBlockSize &&
+           !file_block_cached(cacheKey, start+FileBlockSize))
+            QueueAhead(start+FileBlockSize);
+        return blk;
+    }
+
+    void LoadPrefix()
+    {
+        SyncAhead();
+
+        prefixLoaded = true;
+        if(filePos != 0 && SeekBackend(0, SEEK_SET) != 0)
+            return;
+
+        prefix.resize(PrefixSize);
+        size_t total = 0;
+        while(total < prefix.size())
+        {
+            ALsizei amt = ReadCallback(&prefix[total], prefix.size()-total);
+            if(amt <= 0) break;
+            total += amt;
+        }
+        prefix.resize(total);
+    }
+
+    void ReleasePrefix()
+    {
+        if(!keepPrefix && !prefix.empty())
+            std::vector<char>().swap(prefix);
+    }
+
+    pos_type SeekTo(alureInt64 pos)
+    {
+        if(pos < 0)
+            return traits_type::eof();
+
+        // Stay in the current window if it has the position, or the
+        // prefix if it's still around
+        if(pos >= winStart && pos <= winStart + (egptr()-eback()))
+        {
+            setg(eback(), eback() + (pos-winStart), egptr());
+            return pos;
+        }
+        if(pos < alureInt64(prefix.size()))
+        {
+            setg(&prefix[0], &prefix[pos], &prefix[0] + prefix.size());
+            winStart = 0;
+            return pos;
+        }
+
+        // The backend is only seeked once data is read from the new
+        // position
+        ReleasePrefix();
+        winStart = pos;
+        char *buf = &buffers[current][0];
+        setg(buf, buf, buf);
+        return pos;
+    }
 
     virtual int_type underflow()
     {
         if(usrFile && gptr() == egptr())
         {
-            ALsizei amt = fio.read(usrFile, reinterpret_cast<ALubyte*>(&buffer[0]), sizeof(buffer));
-            if(amt >= 0) setg(buffer, buffer, buffer+amt);
+            alureInt64 pos = GetPos();
+            if(keepPrefix && !prefixLoaded && pos < alureInt64(PrefixSize))
+                LoadPrefix();
+
+            if(pos < alureInt64(prefix.size()))
+            {
+                setg(&prefix[0], &prefix[pos], &prefix[0] + prefix.size());
+                winStart = 0;
+            }
+            else if(!cacheKey.empty())
+            {
+                alureInt64 start = pos - pos%FileBlockSize;
+                FileBlock *next = GetBlock(start);
+                if(block)
+                    release_file_block(block);
+                block = next;
+                if(block && alureInt64(block->Data.size()) <= pos-start)
+                {
+                    release_file_block(block);
+                    block = NULL;
+                }
+
+                if(block)
+                {
+                    char *data = &block->Data[0];
+                    setg(data, data + (pos-start), data + block->Data.size());
+                    winStart = start;
+                }
+                else
+                {
+                    char *buf = &buffers[current][0];
+                    setg(buf, buf, buf);
+                    winStart = pos;
+                }
+            }
+            else
+            {
+                SyncAhead();
+
+                ALsizei amt;
+                if(aheadState == AheadDone && aheadPos == pos)
+                {
+                    current ^= 1;
+                    amt = aheadLen;
+                }
+                else
+                    amt = ReadBackend(pos, buffers[current]);
+                aheadState = AheadIdle;
+
+                ReleasePrefix();
+                winStart = pos;
+                char *buf = &buffers[current][0];
+                setg(buf, buf, buf+amt);
+
+                if(amt > 0 && !buffers[1].empty())
+                    QueueAhead(pos+amt);
+            }
         }
         if(gptr() == egptr())
             return traits_type::eof();
@@ -122,32 +679,30 @@ class FileStreamBuf : public std::streambuf {
     {
         if(!usrFile || (mode&std::ios_base::out))
             return traits_type::eof();
+        if(offset != off_type(alureInt64(offset)))
+            return traits_type::eof();
 
-        pos_type pos = traits_type::eof();
         switch(whence)
         {
             case std::ios_base::beg:
-                if(offset == off_type(alureInt64(offset)))
-                    pos = pos_type(fio.seek(usrFile, offset, SEEK_SET));
-                break;
+                return SeekTo(offset);
 
             case std::ios_base::cur:
-                offset -= off_type(egptr()-gptr());
-                if(offset == off_type(alureInt64(offset)))
-                    pos = pos_type(fio.seek(usrFile, offset, SEEK_CUR));
-                break;
+                return SeekTo(GetPos() + offset);
 
             case std::ios_base::end:
-                if(offset == off_type(alureInt64(offset)))
-                    pos = pos_type(fio.seek(usrFile, offset, SEEK_END));
-                break;
+            {
+                SyncAhead();
+                alureInt64 pos = SeekBackend(offset, SEEK_END);
+                if(pos < 0)
+                    break;
+                return SeekTo(pos);
+            }
 
             default:
                 break;
         }
-        if(pos >= 0)
-            setg(0, 0, 0);
-        return pos;
+        return traits_type::eof();
     }
 
     virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode = std::ios_base::in | std::ios_base::out)
@@ -163,24 +718,148 @@ public:
         return usrFile != NULL;
     }
 
+    alureIOStats GetStats()
+    {
+        EnterCriticalSection(&cs_IOStats);
+        alureIOStats ret = stats;
+        LeaveCriticalSection(&cs_IOStats);
+        return ret;
+    }
+
+    // Called once a decoder has been picked, so the prefix can be let go
+    void EndProbe()
+    {
+        keepPrefix = false;
+        if(!InPrefix())
+            ReleasePrefix();
+    }
+
     FileStreamBuf(const char *filename, ALint mode)
-      : usrFile(NULL), fio(Funcs)
+      : usrFile(NULL), fio(Funcs), name(filename), stats(), current(0),
+        block(NULL), keepPrefix(true), prefixLoaded(false), winStart(0),
+        filePos(0), aheadState(AheadIdle), aheadPos(0), aheadLen(0),
+        aheadNext(NULL)
     {
+        InitializeCriticalSection(&ioLock);
+
+        EnterCriticalSection(&cs_IOStats);
+        logFunc = IOLogFunc;
+        logData = IOLogData;
+        LeaveCriticalSection(&cs_IOStats);
+
+        EnterCriticalSection(&cs_ReadAhead);
+        size_t aheadSize = ReadAheadSize;
+        LeaveCriticalSection(&cs_ReadAhead);
+
+        EnterCriticalSection(&cs_FileCache);
+        bool useCache = (FileCacheMax > 0);
+        LeaveCriticalSection(&cs_FileCache);
+        if(useCache)
+        {
+            // The start of the file stays cached as long as it's needed, so
+            // there's no need for a separate prefix. Readahead reads whole
+            // blocks.
+            cacheKey = get_file_cache_key(filename);
+            if(!cacheKey.empty())
+            {
+                keepPrefix = false;
+                if(aheadSize > 0)
+                    aheadSize = FileBlockSize;
+            }
+        }
+
+        if(aheadSize > 0)
+        {
+            buffers[0].resize(aheadSize);
+            buffers[1].resize(aheadSize);
+        }
+        else
+            buffers[0].resize(4096);
+        char *buf = &buffers[current][0];
+        setg(buf, buf, buf);
+
+        alureUInt64 start = GetTimeUS();
         usrFile = fio.hasUserdata ? fio.openWithUserdata(fio.userdata, filename, mode)
                                   : fio.open(filename, mode);
+        alureIOStats delta = alureIOStats();
+        delta.callbackTime = GetTimeUS() - start;
+        RecordIO(delta, ALURE_IO_OPEN, 0, usrFile ? 0 : -1);
+#ifdef HAVE_POSIX_FADVISE
+        // Let the OS know to read ahead aggressively too
+        if(usrFile && aheadSize > 0 && UsingSTDIO)
+            posix_fadvise(fileno((FILE*)usrFile), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
     }
     virtual ~FileStreamBuf()
     {
+        SyncAhead();
+        if(block)
+            release_file_block(block);
         if(usrFile)
+        {
+            alureUInt64 start = GetTimeUS();
             fio.close(usrFile);
+            alureIOStats delta = alureIOStats();
+            delta.callbackTime = GetTimeUS() - start;
+            RecordIO(delta, ALURE_IO_CLOSE, filePos, 0);
+        }
+        DeleteCriticalSection(&ioLock);
     }
 };
 
+// Waits for the readahead thread to finish, when the library is unloaded
+void StopReadAhead(void)
+{
+    if(ReadAheadThread)
+        StopThread(ReadAheadThread);
+    ReadAheadThread = NULL;
+}
+
+// Frees the file cache, when the library is unloaded
+void ClearFileCache(void)
+{
+    EnterCriticalSection(&cs_FileCache);
+    trim_file_cache(0);
+    if(FileBlocks && FileBlocks->empty())
+    {
+        delete FileBlocks;
+        FileBlocks = NULL;
+    }
+    LeaveCriticalSection(&cs_FileCache);
+}
+
+// Called when the I/O routines change. Blocks still in use stay cached until
+// they're released, but can no longer be found.
+static void new_file_cache_generation(void)
+{
+    EnterCriticalSection(&cs_FileCache);
+    FileCacheGeneration++;
+    LeaveCriticalSection(&cs_FileCache);
+    ClearFileCache();
+}
+
 
 InStream::InStream(const char *filename)
-  : std::istream(new FileStreamBuf(filename, 0))
+  : std::istream(NULL)
 {
-    if(!(static_cast<FileStreamBuf*>(rdbuf())->IsOpen()))
+    if(!filename)
+    {
+        clear(failbit);
+        return;
+    }
+
+    // Pack entries, and local files when using the default I/O routines, are
+    // mapped and read straight from memory
+    FileMapping mapping;
+    if(MapFile(filename, &mapping))
+    {
+        rdbuf(new MemStreamBuf(mapping));
+        return;
+    }
+
+    FileStreamBuf *buf = new FileStreamBuf(filename, 0);
+    rdbuf(buf);
+    if(!buf->IsOpen())
         clear(failbit);
 }
 
@@ -194,13 +873,153 @@ InStream::~InStream()
     delete rdbuf();
 }
 
+const ALubyte *GetStreamMemory(std::istream *stream, alureUInt64 *length)
+{
+    MemStreamBuf *buf = dynamic_cast<MemStreamBuf*>(stream->rdbuf());
+    if(!buf) return NULL;
+    return buf->GetMemory(length);
+}
+
+bool TakeStreamMapping(std::istream *stream, FileMapping *mapping)
+{
+    if(!stream) return false;
+    MemStreamBuf *buf = dynamic_cast<MemStreamBuf*>(stream->rdbuf());
+    if(!buf) return false;
+    return buf->TakeMapping(mapping);
+}
 
-static void *open_wrap(const char *filename, ALuint mode)
+bool GetStreamIOStats(std::istream *stream, alureIOStats *stats)
+{
+    FileStreamBuf *buf = (stream ? dynamic_cast<FileStreamBuf*>(stream->rdbuf()) : NULL);
+    if(!buf) return false;
+    *stats = buf->GetStats();
+    return true;
+}
+
+void EndStreamProbe(std::istream *stream)
+{
+    FileStreamBuf *buf = dynamic_cast<FileStreamBuf*>(stream->rdbuf());
+    if(buf) buf->EndProbe();
+}
+
+
+#ifdef HAVE_WINDOWS_H
+
+bool MapLocalFile(const char *filename, FileMapping *mapping)
+{
+    mapping->File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(mapping->File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(mapping->File, &size) || size.QuadPart == 0 ||
+       size.QuadPart != LONGLONG(size_t(size.QuadPart)))
+    {
+        CloseHandle(mapping->File);
+        return false;
+    }
+
+    mapping->Mapping = CreateFileMapping(mapping->File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping->Mapping)
+    {
+        CloseHandle(mapping->File);
+        return false;
+    }
+
+    mapping->Data = static_cast<const ALubyte*>(MapViewOfFile(mapping->Mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!mapping->Data)
+    {
+        CloseHandle(mapping->Mapping);
+        CloseHandle(mapping->File);
+        return false;
+    }
+    mapping->Length = size_t(size.QuadPart);
+    return true;
+}
+
+void UnmapLocalFile(FileMapping *mapping)
+{
+    if(mapping->Data)
+    {
+        UnmapViewOfFile(mapping->Data);
+        CloseHandle(mapping->Mapping);
+        CloseHandle(mapping->File);
+    }
+    mapping->Data = NULL;
+    mapping->Length = 0;
+}
+
+#elif defined(HAVE_MMAP)
+
+bool MapLocalFile(const char *filename, FileMapping *mapping)
 {
-    if(mode != 0)
-        return NULL;
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+       st.st_size != off_t(size_t(st.st_size)))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED)
+        return false;
 
-    return fopen(filename, "rb");
+    mapping->Data = static_cast<const ALubyte*>(ptr);
+    mapping->Length = st.st_size;
+    return true;
+}
+
+void UnmapLocalFile(FileMapping *mapping)
+{
+    if(mapping->Data)
+        munmap(const_cast<ALubyte*>(mapping->Data), mapping->Length);
+    mapping->Data = NULL;
+    mapping->Length = 0;
+}
+
+#else
+
+bool MapLocalFile(const char*, FileMapping*)
+{ return false; }
+
+void UnmapLocalFile(FileMapping *mapping)
+{
+    mapping->Data = NULL;
+    mapping->Length = 0;
+}
+
+#endif
+
+bool MapFile(const char *filename, FileMapping *mapping)
+{
+    if(MapPackEntry(filename, mapping))
+        return true;
+    return UsingSTDIO && MapLocalFile(filename, mapping);
+}
+
+void UnmapFile(FileMapping *mapping)
+{
+    if(mapping->Pack)
+        UnmapPackEntry(mapping);
+    else
+        UnmapLocalFile(mapping);
+}
+
+
+static void *open_wrap(const char *filename, ALuint mode)
+{
+    if(mode == 0)
+        return fopen(filename, "rb");
+    if(mode == 1)
+        return fopen(filename, "wb");
+    return NULL;
 }
 
 static void close_wrap(void *user_data)
@@ -313,6 +1132,7 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetIOCallbacks(
         Funcs.write = write;
         Funcs.seek = seek;
         UsingSTDIO = false;
+        new_file_cache_generation();
         return AL_TRUE;
     }
 
@@ -325,6 +1145,7 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetIOCallbacks(
         Funcs.write = write_wrap;
         Funcs.seek = seek_wrap;
         UsingSTDIO = true;
+        new_file_cache_generation();
         return AL_TRUE;
     }
 
@@ -396,6 +1217,7 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetIOCallbacksUserdata(
         Funcs.write = write;
         Funcs.seek = seek;
         UsingSTDIO = false;
+        new_file_cache_generation();
         return AL_TRUE;
     }
 
@@ -408,10 +1230,163 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetIOCallbacksUserdata(
         Funcs.write = write_wrap;
         Funcs.seek = seek_wrap;
         UsingSTDIO = true;
+        new_file_cache_generation();
         return AL_TRUE;
     }
 
     SetError("Missing callback functions");
     return AL_FALSE;
 }
+
+/* Function: alureSetReadAhead
+ *
+ * Sets the size of the blocks read in the background for files opened for
+ * decoding. While a stream decodes one block, a background thread reads the
+ * next one through the I/O callbacks, so a slow disk or network volume
+ * doesn't stall the thread decoding. The I/O callbacks will then be called
+ * from the background thread too, though never for the same file at the same
+ * time. Sizes below 4KB are rounded up, and 0 disables readahead (the
+ * default). Only affects files opened after the call.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureSetIOCallbacks>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetReadAhead(ALuint size)
+{
+    if(size > 0x7fffffff)
+    {
+        SetError("Invalid readahead size");
+        return AL_FALSE;
+    }
+    if(size > 0 && size < 4096)
+        size = 4096;
+
+    EnterCriticalSection(&cs_ReadAhead);
+    ReadAheadSize = size;
+    LeaveCriticalSection(&cs_ReadAhead);
+    return AL_TRUE;
+}
+
+/* Function: alureSetFileCacheSize
+ *
+ * Sets the maximum number of bytes of file data kept in memory by the file
+ * cache. When enabled, files opened for decoding that can't be mapped into
+ * memory are read in 64KB blocks that are kept and shared, so streams playing
+ * the same file at the same time or one after another read it from disk only
+ * once. Files are identified by name, size, and modification time. Files
+ * opened through custom I/O callbacks (see <alureSetIOCallbacks>) can't be
+ * checked for changes, so they aren't cached. Changing the I/O callbacks
+ * starts the cache over. The least recently used blocks not being read by a
+ * stream are dropped to stay within the given size. A size of 0 (the default)
+ * disables the cache and frees everything in it. Only affects files opened
+ * after the call.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureSetIOCallbacks>, <alureSetBufferCacheSize>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetFileCacheSize(alureUInt64 size)
+{
+    EnterCriticalSection(&cs_FileCache);
+    FileCacheMax = size;
+    trim_file_cache(FileCacheMax);
+    LeaveCriticalSection(&cs_FileCache);
+
+    return AL_TRUE;
+}
+
+/* Function: alureGetBackendSeekCount
+ *
+ * Retrieves the number of seeks made through the I/O callbacks (see
+ * <alureSetIOCallbacks>) on files opened for decoding, since the library was
+ * loaded. Seeks within data that's already been read are handled in memory and
+ * aren't counted.
+ *
+ * Returns:
+ * The total number of backend seeks.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureGetIOStats>
+ */
+ALURE_API alureUInt64 ALURE_APIENTRY alureGetBackendSeekCount(void)
+{
+    EnterCriticalSection(&cs_IOStats);
+    alureUInt64 count = IOTotals.seeks;
+    LeaveCriticalSection(&cs_IOStats);
+    return count;
+}
+
+/* Function: alureGetIOStats
+ *
+ * Retrieves the totals of the I/O done through the I/O callbacks (see
+ * <alureSetIOCallbacks>) by files opened for decoding, since the library was
+ * loaded: the number of read calls and bytes read, the number of seeks and
+ * the total distance seeked, and the time spent in the callbacks, including
+ * opening and closing, in microseconds. Files that are mapped into memory,
+ * such as local files with the default I/O routines and entries of mounted
+ * packs, don't go through the callbacks and aren't counted.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureGetStreamIOStats>, <alureSetIOLogCallback>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureGetIOStats(alureIOStats *stats)
+{
+    if(!stats)
+    {
+        SetError("Invalid stats pointer");
+        return AL_FALSE;
+    }
+
+    EnterCriticalSection(&cs_IOStats);
+    *stats = IOTotals;
+    LeaveCriticalSection(&cs_IOStats);
+    return AL_TRUE;
+}
+
+/* Function: alureSetIOLogCallback
+ *
+ * Sets a callback to log each access made through the I/O callbacks by files
+ * opened for decoding, in the order they're made. The event is one of
+ * ALURE_IO_OPEN, ALURE_IO_READ, ALURE_IO_SEEK, or ALURE_IO_CLOSE, and the
+ * filename is the one the file was opened with. For reads, offset is where the
+ * read started and length is the value the read callback returned. For seeks,
+ * offset is the new position (-1 if the seek failed). For opens, length is -1
+ * if the file couldn't be opened. The callback may be called from the
+ * readahead thread (see <alureSetReadAhead>). Passing NULL disables logging.
+ * Only affects files opened after the call.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureGetIOStats>, <alureGetStreamIOStats>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetIOLogCallback(
+      void (*callback)(void *userdata, const ALchar *filename, ALenum event, alureInt64 offset, alureInt64 length),
+      void *userdata)
+{
+    EnterCriticalSection(&cs_IOStats);
+    IOLogFunc = callback;
+    IOLogData = userdata;
+    LeaveCriticalSection(&cs_IOStats);
+    return AL_TRUE;
+}
 } // extern "C"
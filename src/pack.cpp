@@ -0,0 +1,325 @@
+/*
+ * ALURE  OpenAL utility library
+ * Copyright (c) 2009 by Chris Robinson.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Title: Pack Files */
+
+#include "config.h"
+
+#include "main.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <sstream>
+
+
+static const char PackMagic[8] = { 'A','L','U','R','E','P','A','K' };
+static const ALuint PackVersion = 1;
+
+struct PackEntry {
+    const char *Name;
+    size_t NameLen;
+    size_t Offset;
+    size_t Length;
+};
+
+// A mounted pack file. It's held by the mount list and by each view mapped
+// from it, so unmounting doesn't invalidate data still in use.
+struct PackFile {
+    std::string Path;
+    FileMapping Mapping;
+    // Sorted by name, pointing into the mapping
+    std::vector<PackEntry> Index;
+    ALuint RefCount;
+    // Unique to each mount, so cache keys made from it can't be confused
+    // with those of a pack remounted with new contents
+    ALuint Serial;
+    PackFile *Next;
+};
+
+// Mounted packs, most recently mounted first. Guarded by cs_PackList, as are
+// the packs' reference counts. A plain list, since it's still used by
+// deinit_alure after static objects may have been destroyed.
+static PackFile *PackList = NULL;
+static ALuint PackSerial = 0;
+
+
+static inline alureUInt64 get_le(const ALubyte *ptr, int bytes)
+{
+    alureUInt64 val = 0;
+    while(bytes-- > 0)
+        val = (val<<8) | ptr[bytes];
+    return val;
+}
+
+// Compares a stored entry name with a null-terminated name, in byte order
+static int compare_name(const PackEntry &entry, const char *name, size_t len)
+{
+    int cmp = memcmp(entry.Name, name, std::min(entry.NameLen, len));
+    if(cmp != 0) return cmp;
+    if(entry.NameLen < len) return -1;
+    if(entry.NameLen > len) return 1;
+    return 0;
+}
+
+// Reads and validates the pack's index. Entries have to be in strictly
+// increasing name order, and lie within the file.
+static bool load_index(PackFile *pack)
+{
+    const ALubyte *data = pack->Mapping.Data;
+    size_t length = pack->Mapping.Length;
+
+    if(length < 16 || memcmp(data, PackMagic, sizeof(PackMagic)) != 0 ||
+       get_le(data+8, 4) != PackVersion)
+        return false;
+
+    alureUInt64 count = get_le(data+12, 4);
+    size_t pos = 16;
+    pack->Index.reserve(std::min<alureUInt64>(count, (length-pos) / 20));
+    while(count-- > 0)
+    {
+        if(length-pos < 4)
+            return false;
+        PackEntry entry;
+        entry.NameLen = get_le(data+pos, 4);
+        pos += 4;
+        if(length-pos < entry.NameLen || length-pos-entry.NameLen < 16)
+            return false;
+        entry.Name = reinterpret_cast<const char*>(data+pos);
+        pos += entry.NameLen;
+
+        alureUInt64 offset = get_le(data+pos, 8);
+        alureUInt64 size = get_le(data+pos+8, 8);
+        pos += 16;
+        if(offset > length || size > length-offset)
+            return false;
+        entry.Offset = offset;
+        entry.Length = size;
+
+        if(!pack->Index.empty() &&
+           compare_name(pack->Index.back(), entry.Name, entry.NameLen) >= 0)
+            return false;
+        pack->Index.push_back(entry);
+    }
+    return true;
+}
+
+// Drops a reference to the pack, unmapping it with the last one. Must be
+// called with cs_PackList held.
+static void release_pack(PackFile *pack)
+{
+    if(--pack->RefCount > 0)
+        return;
+    UnmapLocalFile(&pack->Mapping);
+    delete pack;
+}
+
+// Looks for the name in the pack's index
+static const PackEntry *find_entry(const PackFile *pack, const char *name)
+{
+    size_t len = strlen(name);
+    size_t low = 0, high = pack->Index.size();
+    while(low < high)
+    {
+        size_t mid = low + (high-low)/2;
+        int cmp = compare_name(pack->Index[mid], name, len);
+        if(cmp == 0)
+            return &pack->Index[mid];
+        if(cmp < 0)
+            low = mid+1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
+
+
+bool MapPackEntry(const char *name, FileMapping *mapping)
+{
+    if(!name)
+        return false;
+
+    bool found = false;
+    EnterCriticalSection(&cs_PackList);
+    PackFile *pack = PackList;
+    while(pack && !found)
+    {
+        const PackEntry *entry = find_entry(pack, name);
+        if(entry)
+        {
+            pack->RefCount++;
+            mapping->Data = pack->Mapping.Data + entry->Offset;
+            mapping->Length = entry->Length;
+            mapping->Pack = pack;
+            found = true;
+        }
+        pack = pack->Next;
+    }
+    LeaveCriticalSection(&cs_PackList);
+    return found;
+}
+
+std::string GetPackEntryKey(const FileMapping *mapping)
+{
+    std::ostringstream key;
+    key << "p:" << mapping->Pack->Serial << ':' <<
+           size_t(mapping->Data - mapping->Pack->Mapping.Data) << ':' <<
+           mapping->Length;
+    return key.str();
+}
+
+void UnmapPackEntry(FileMapping *mapping)
+{
+    EnterCriticalSection(&cs_PackList);
+    release_pack(mapping->Pack);
+    LeaveCriticalSection(&cs_PackList);
+    mapping->Data = NULL;
+    mapping->Length = 0;
+    mapping->Pack = NULL;
+}
+
+void UnmountPacks(void)
+{
+    EnterCriticalSection(&cs_PackList);
+    while(PackList)
+    {
+        PackFile *pack = PackList;
+        PackList = pack->Next;
+        release_pack(pack);
+    }
+    LeaveCriticalSection(&cs_PackList);
+}
+
+
+extern "C" {
+
+/* Function: alureMountPack
+ *
+ * Mounts a pack file, so the files stored in it can be loaded by name with
+ * <alureCreateBufferFromFile>, <alureCreateStreamFromFile>, and the other
+ * functions taking a filename. The pack is mapped into memory once, and its
+ * files are read straight from the mapping; a lookup is a binary search of the
+ * pack's index. Names are checked against mounted packs, most recently mounted
+ * first, before being opened through the I/O callbacks. The pack itself is
+ * always read from the local file system.
+ *
+ * A pack is an uncompressed archive laid out as follows, with all values
+ * little-endian:
+ *
+ * - The 8 bytes "ALUREPAK", a 32-bit version (1), and a 32-bit entry count.
+ * - For each entry, a 32-bit name length, the name (without a terminator),
+ *   then 64-bit offset and length of the file data from the start of the pack.
+ *   Entries must be sorted by name, compared byte-wise, with no duplicates.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureUnmountPack>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureMountPack(const ALchar *fname)
+{
+    if(!fname)
+    {
+        SetError("Invalid filename");
+        return AL_FALSE;
+    }
+
+    PackFile *pack = new PackFile;
+    pack->Path = fname;
+    pack->RefCount = 1;
+    pack->Next = NULL;
+    if(!MapLocalFile(fname, &pack->Mapping))
+    {
+        delete pack;
+        SetError("Failed to open pack");
+        return AL_FALSE;
+    }
+    if(!load_index(pack))
+    {
+        UnmapLocalFile(&pack->Mapping);
+        delete pack;
+        SetError("Invalid pack file");
+        return AL_FALSE;
+    }
+
+    EnterCriticalSection(&cs_PackList);
+    pack->Serial = ++PackSerial;
+    pack->Next = PackList;
+    PackList = pack;
+    LeaveCriticalSection(&cs_PackList);
+    return AL_TRUE;
+}
+
+/* Function: alureUnmountPack
+ *
+ * Unmounts the most recently mounted pack with the given filename. Buffers and
+ * streams already created from the pack stay valid; the pack is unmapped once
+ * they're gone.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureMountPack>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureUnmountPack(const ALchar *fname)
+{
+    if(!fname)
+    {
+        SetError("Invalid filename");
+        return AL_FALSE;
+    }
+
+    bool found = false;
+    EnterCriticalSection(&cs_PackList);
+    PackFile **link = &PackList;
+    while(*link && !found)
+    {
+        PackFile *pack = *link;
+        if(pack->Path == fname)
+        {
+            *link = pack->Next;
+            release_pack(pack);
+            found = true;
+        }
+        else
+            link = &pack->Next;
+    }
+    LeaveCriticalSection(&cs_PackList);
+
+    if(!found)
+    {
+        SetError("Pack not mounted");
+        return AL_FALSE;
+    }
+    return AL_TRUE;
+}
+
+} // extern "C"
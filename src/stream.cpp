@@ -33,6 +33,46 @@
 
 static bool SizeIsUS = false;
 
+bool alureStream::Seek(alureUInt64 frame)
+{
+    ALenum format;
+    ALuint freq, blockAlign;
+
+    if(!GetFormat(&format, &freq, &blockAlign))
+    {
+        SetError("Could not get stream format");
+        return false;
+    }
+
+    ALuint framesPerBlock = DetectCompressionRate(format);
+    if(framesPerBlock == 0 || blockAlign == 0)
+    {
+        SetError("Unknown compression rate");
+        return false;
+    }
+
+    if(!Rewind())
+        return false;
+
+    alureUInt64 skip = frame / framesPerBlock * blockAlign;
+    std::vector<ALubyte> discard;
+    while(skip > 0)
+    {
+        ALuint todo = std::min<alureUInt64>(skip, std::max<ALuint>(65536/blockAlign, 1)*blockAlign);
+        ALuint got = todo;
+        if(!GetDataPtr(&got))
+        {
+            if(discard.size() < todo)
+                discard.resize(todo);
+            got = GetData(&discard[0], todo);
+        }
+        if(got == 0)
+            break;
+        skip -= std::min<alureUInt64>(got, skip);
+    }
+    return true;
+}
+
 static alureStream *InitStream(alureStream *instream, ALsizei chunkLength, ALsizei numBufs, ALuint *bufs)
 {
     std::auto_ptr<std::istream> fstream(instream->fstream);
@@ -90,6 +130,7 @@ static alureStream *InitStream(alureStream *instream, ALsizei chunkLength, ALsiz
     }
 
     stream->dataChunk.resize(chunkLength);
+    stream->AddMemoryUsage(chunkLength);
 
     if(numBufs > 0)
     {
@@ -104,11 +145,12 @@ static alureStream *InitStream(alureStream *instream, ALsizei chunkLength, ALsiz
     ALsizei filled;
     for(filled = 0;filled < numBufs;filled++)
     {
-        ALuint got = stream->GetData(&stream->dataChunk[0], stream->dataChunk.size());
+        const ALubyte *chunk;
+        ALuint got = stream->GetChunk(&chunk);
         got -= got%blockAlign;
         if(got == 0) break;
 
-        alBufferData(bufs[filled], format, &stream->dataChunk[0], got, freq);
+        alBufferData(bufs[filled], format, chunk, got, freq);
     }
 
     while(filled < numBufs)
@@ -129,6 +171,93 @@ static alureStream *InitStream(alureStream *instream, ALsizei chunkLength, ALsiz
     return stream.release();
 }
 
+// Describes the stream from its decoder, then closes it. No audio is
+// buffered, so no context is needed. The decoder is opened just as it would be
+// for playback, so this costs whatever opening that format costs.
+static bool probe_stream(alureStream *instream, alureProbeInfo *info)
+{
+    info->format = AL_NONE;
+    info->frequency = 0;
+    info->channels = 0;
+    info->frames = 0;
+    if(!instream)
+        return false;
+
+    std::auto_ptr<std::istream> fstream(instream->fstream);
+    std::auto_ptr<alureStream> stream(instream);
+    ALenum format;
+    ALuint freq, blockAlign;
+
+    if(!stream->GetFormat(&format, &freq, &blockAlign))
+    {
+        SetError("Could not get stream format");
+        return false;
+    }
+    if(format == AL_NONE || format == -1)
+    {
+        SetError("No valid format");
+        return false;
+    }
+
+    info->format = format;
+    info->frequency = freq;
+    info->channels = DetectChannels(format);
+    info->frames = std::max<alureInt64>(stream->GetLength(), 0);
+    return true;
+}
+
+// State shared between the threads of a batch probe
+struct ProbeBatch {
+    const ALchar *const *fnames;
+    alureProbeInfo *infos;
+    ALsizei count;
+    ALCcontext *ctx;
+
+    CRITICAL_SECTION lock;
+    ALsizei next;
+    ALsizei probed;
+
+    ProbeBatch(const ALchar *const *_fnames, alureProbeInfo *_infos, ALsizei _count)
+      : fnames(_fnames), infos(_infos), count(_count), ctx(NULL), next(0),
+        probed(0)
+    { InitializeCriticalSection(&lock); }
+    ~ProbeBatch()
+    { DeleteCriticalSection(&lock); }
+
+    // Probes the next unclaimed file. Returns false when there are none left.
+    bool ProbeNext()
+    {
+        EnterCriticalSection(&lock);
+        ALsizei idx = next;
+        if(idx < count) next++;
+        LeaveCriticalSection(&lock);
+        if(idx >= count)
+            return false;
+
+        bool ok = probe_stream(create_stream(fnames[idx]), &infos[idx]);
+
+        EnterCriticalSection(&lock);
+        if(ok) probed++;
+        LeaveCriticalSection(&lock);
+        return true;
+    }
+};
+
+static ALuint probe_worker(ALvoid *ptr)
+{
+    ProbeBatch *batch = static_cast<ProbeBatch*>(ptr);
+
+    // Decoders check formats against the caller's context, if it has one
+    if(alcSetThreadContext)
+        alcSetThreadContext(batch->ctx);
+    while(batch->ProbeNext())
+    {
+    }
+    if(alcSetThreadContext)
+        alcSetThreadContext(NULL);
+    return 0;
+}
+
 
 extern "C" {
 
@@ -249,6 +378,7 @@ ALURE_API alureStream* ALURE_APIENTRY alureCreateStreamFromMemory(const ALubyte
     if(!stream) return NULL;
 
     stream->data = streamData;
+    stream->AddMemoryUsage(length);
     return InitStream(stream, chunkLength, numBufs, bufs);
 }
 
@@ -448,11 +578,12 @@ ALURE_API ALsizei ALURE_APIENTRY alureBufferDataFromStream(alureStream *stream,
     ALsizei filled;
     for(filled = 0;filled < numBufs;filled++)
     {
-        ALuint got = stream->GetData(&stream->dataChunk[0], stream->dataChunk.size());
+        const ALubyte *chunk;
+        ALuint got = stream->GetChunk(&chunk);
         got -= got%blockAlign;
         if(got == 0) break;
 
-        alBufferData(bufs[filled], format, &stream->dataChunk[0], got, freq);
+        alBufferData(bufs[filled], format, chunk, got, freq);
         if(alGetError() != AL_NO_ERROR)
         {
             SetError("Buffer load failed");
@@ -482,7 +613,10 @@ ALURE_API ALboolean ALURE_APIENTRY alureRewindStream(alureStream *stream)
         return AL_FALSE;
     }
 
-    return stream->Rewind();
+    LockStreamDecode(stream);
+    ALboolean ret = stream->Rewind();
+    UnlockStreamDecode(stream, ret != AL_FALSE);
+    return ret;
 }
 
 /* Function: alureSetStreamOrder
@@ -507,7 +641,10 @@ ALURE_API ALboolean ALURE_APIENTRY alureSetStreamOrder(alureStream *stream, ALui
         return AL_FALSE;
     }
 
-    return stream->SetOrder(order);
+    LockStreamDecode(stream);
+    ALboolean ret = stream->SetOrder(order);
+    UnlockStreamDecode(stream, ret != AL_FALSE);
+    return ret;
 }
 
 /* Function: alureSetStreamPatchset
@@ -555,6 +692,203 @@ ALURE_API alureInt64 ALURE_APIENTRY alureGetStreamLength(alureStream *stream)
     return stream->GetLength();
 }
 
+/* Function: alureSetStreamOffset
+ *
+ * Seeks the stream to the given sample frame, so the next
+ * alureBufferDataFromStream call will decode from there. Data already
+ * buffered is not affected. Most decoders seek directly; others rewind and
+ * decode up to the offset. For block-compressed formats (eg. IMA4), the
+ * stream is placed at the start of the block containing the frame.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureGetStreamOffset>, <alureRewindStream>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureSetStreamOffset(alureStream *stream, alureUInt64 frame)
+{
+    if(!alureStream::Verify(stream))
+    {
+        SetError("Invalid stream pointer");
+        return AL_FALSE;
+    }
+
+    LockStreamDecode(stream);
+    ALboolean ret = stream->Seek(frame);
+    UnlockStreamDecode(stream, ret != AL_FALSE);
+    return ret;
+}
+
+/* Function: alureGetStreamOffset
+ *
+ * Retrieves the sample frame the stream will next decode from. Not all
+ * decoders can return this. While the stream is playing, this is ahead of the
+ * source by the data that's been decoded and queued.
+ *
+ * Returns:
+ * -1 on error, or if the offset is unknown.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureSetStreamOffset>
+ */
+ALURE_API alureInt64 ALURE_APIENTRY alureGetStreamOffset(alureStream *stream)
+{
+    if(!alureStream::Verify(stream))
+    {
+        SetError("Invalid stream pointer");
+        return -1;
+    }
+
+    LockStreamDecode(stream);
+    alureInt64 ret = stream->Tell();
+    UnlockStreamDecode(stream, false);
+    return ret;
+}
+
+/* Function: alureGetStreamIOStats
+ *
+ * Retrieves the I/O the stream's file has done through the I/O callbacks
+ * since it was opened, as described for <alureGetIOStats>. Streams that don't
+ * read through the callbacks, such as those reading from memory or from a
+ * mapped file, report zeros.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureGetIOStats>, <alureSetIOLogCallback>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureGetStreamIOStats(alureStream *stream, alureIOStats *stats)
+{
+    if(!alureStream::Verify(stream))
+    {
+        SetError("Invalid stream pointer");
+        return AL_FALSE;
+    }
+    if(!stats)
+    {
+        SetError("Invalid stats pointer");
+        return AL_FALSE;
+    }
+
+    if(!GetStreamIOStats(stream->fstream, stats))
+        memset(stats, 0, sizeof(*stats));
+    return AL_TRUE;
+}
+
+/* Function: alureProbeFile
+ *
+ * Describes a file without creating a stream for it: nothing is buffered, and
+ * no context is required. The format is the one the file would be decoded to.
+ * With a current context, it's checked for support as when loading; without
+ * one, the standard format value is given. Frames is the approximate length in
+ * sample frames, or 0 if the decoder can't tell.
+ *
+ * The file's decoder is opened as for a stream, which for most formats only
+ * reads the headers. Some formats are opened in full, though: FLAC decodes its
+ * first frame, module files (through ModPlug or DUMB) are loaded entirely, and
+ * MIDI files have all their tracks read and a synth created. Probing those is
+ * about as costly as opening a stream for them.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureProbeMemory>, <alureProbeFiles>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureProbeFile(const ALchar *fname, alureProbeInfo *info)
+{
+    if(!info)
+    {
+        SetError("Invalid info pointer");
+        return AL_FALSE;
+    }
+
+    return probe_stream(create_stream(fname), info);
+}
+
+/* Function: alureProbeMemory
+ *
+ * Describes a file image in memory, like <alureProbeFile>.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureProbeFile>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureProbeMemory(const ALubyte *fdata, ALuint length, alureProbeInfo *info)
+{
+    if(!info)
+    {
+        SetError("Invalid info pointer");
+        return AL_FALSE;
+    }
+
+    MemDataInfo memData;
+    memData.Data = fdata;
+    memData.Length = length;
+    memData.Pos = 0;
+    return probe_stream(create_stream(memData), info);
+}
+
+/* Function: alureProbeFiles
+ *
+ * Describes the given files, like calling <alureProbeFile> for each one. The
+ * files are probed in parallel on a pool of worker threads sized to the number
+ * of processors. Files that fail to probe get a format of AL_NONE.
+ *
+ * Returns:
+ * The number of files successfully probed, or -1 on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureProbeFile>
+ */
+ALURE_API ALsizei ALURE_APIENTRY alureProbeFiles(const ALchar *const *fnames, ALsizei count, alureProbeInfo *infos)
+{
+    if(count < 0)
+    {
+        SetError("Invalid file count");
+        return -1;
+    }
+    if(count == 0)
+        return 0;
+
+    ProbeBatch batch(fnames, infos, count);
+    batch.ctx = alcGetCurrentContext();
+
+    // The calling thread probes alongside the workers
+    std::vector<ThreadInfo*> threads;
+    ALuint numThreads = std::min<ALuint>(GetProcessorCount(), count);
+    while(threads.size()+1 < numThreads)
+    {
+        ThreadInfo *thread = StartThread(probe_worker, &batch);
+        if(!thread) break;
+        threads.push_back(thread);
+    }
+
+    while(batch.ProbeNext())
+    {
+    }
+    for(size_t i = 0;i < threads.size();i++)
+        StopThread(threads[i]);
+
+    return batch.probed;
+}
+
 /* Function: alureDestroyStream
  *
  * Closes an opened stream. For convenience, it will also delete the given
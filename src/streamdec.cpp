@@ -26,6 +26,7 @@
 #include "main.h"
 
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 
 #include <algorithm>
@@ -41,18 +42,57 @@
 const Decoder::ListType& Decoder::GetList()
 { return AddList(); }
 
-Decoder::ListType& Decoder::AddList(Decoder::FactoryType func, ALint prio)
+Decoder::ListType& Decoder::AddList(Decoder::FactoryType func, Decoder::ProbeType probe,
+                                    const char *exts, ALint prio)
 {
     static ListType FuncList;
     if(func)
     {
         assert(std::find_if(FuncList.begin(), FuncList.end(), FindSecond(func)) == FuncList.end());
-        FuncList.insert(std::make_pair(prio, func));
+        Entry entry = { func, probe, exts };
+        FuncList.insert(std::make_pair(prio, entry));
     }
     return FuncList;
 }
 
 
+static const char *get_extension(const char *fname)
+{
+    const char *ext = NULL;
+    for(;*fname;fname++)
+    {
+        if(*fname == '.')
+            ext = fname+1;
+        else if(*fname == '/' || *fname == '\\')
+            ext = NULL;
+    }
+    return ext;
+}
+static const char *get_extension(const MemDataInfo&)
+{ return NULL; }
+
+static bool has_extension(const char *exts, const char *ext)
+{
+    if(!exts || !ext || !*ext)
+        return false;
+
+    while(*exts)
+    {
+        size_t i = 0;
+        while(ext[i] && exts[i] != ',' && exts[i] &&
+              tolower((unsigned char)ext[i]) == tolower((unsigned char)exts[i]))
+            i++;
+        if(!ext[i] && (!exts[i] || exts[i] == ','))
+            return true;
+
+        exts = strchr(exts, ',');
+        if(!exts) break;
+        exts++;
+    }
+    return false;
+}
+
+
 struct customStream : public alureStream {
     void *usrFile;
     ALenum format;
@@ -132,20 +172,51 @@ static alureStream *get_stream_decoder(const T &fdata)
     std::istream *file = new InStream(fdata);
     if(!file->fail())
     {
-        const Decoder::ListType Factories = Decoder::GetList();
+        // Sniff the header once, and only construct the decoders that could
+        // handle it. Signature matches go first, then the decoders that can't
+        // tell, preferring those that handle the file's extension. Priority
+        // order is kept within each group.
+        ALubyte header[Decoder::ProbeSize];
+        file->read(reinterpret_cast<char*>(header), sizeof(header));
+        size_t hdrlen = file->gcount();
+
+        const char *ext = get_extension(fdata);
+        std::vector<std::pair<ALint,Decoder::FactoryType> > candidates;
+
+        const Decoder::ListType &Factories = Decoder::GetList();
         Decoder::ListType::const_reverse_iterator factory = Factories.rbegin();
         Decoder::ListType::const_reverse_iterator end = Factories.rend();
         while(factory != end)
         {
-            file->clear();
-            file->seekg(0, std::ios_base::beg);
-
-            std::auto_ptr<alureStream> stream(factory->second(file));
-            if(stream.get() != NULL) return stream.release();
-
+            const Decoder::Entry &entry = factory->second;
+            Decoder::ProbeResult res = entry.Probe(header, hdrlen);
+            if(res != Decoder::NoMatch)
+            {
+                ALint rank = res*2 + (has_extension(entry.Extensions, ext) ? 1 : 0);
+                candidates.push_back(std::make_pair(rank, entry.Factory));
+            }
             factory++;
         }
 
+        for(ALint rank = Decoder::Match*2 + 1;rank >= Decoder::MaybeMatch*2;rank--)
+        {
+            for(size_t c = 0;c < candidates.size();c++)
+            {
+                if(candidates[c].first != rank)
+                    continue;
+
+                file->clear();
+                file->seekg(0, std::ios_base::beg);
+
+                std::auto_ptr<alureStream> stream(candidates[c].second(file));
+                if(stream.get() != NULL)
+                {
+                    EndStreamProbe(file);
+                    return stream.release();
+                }
+            }
+        }
+
         SetError("Unsupported type");
         delete file;
     }
@@ -28,134 +28,331 @@
 #include "main.h"
 
 #include <list>
+#include <map>
 #include <vector>
 
-#ifdef HAVE_WINDOWS_H
+// This object is used to make sure the current context isn't switched out on
+// us by another thread, by setting the current thread context to the current
+// context. The old thread context is then restored when the object goes out
+// of scope.
+// This obviously only works when ALC_EXT_thread_local_context is supported
+// The thread context is tracked, so it's only set when it has to change.
+struct ProtectContext {
+	ProtectContext()
+	{ protect(); }
 
-typedef struct {
-    ALuint (*func)(ALvoid*);
-    ALvoid *ptr;
-    HANDLE thread;
-} ThreadInfo;
+	~ProtectContext()
+	{ unprotect(); }
 
-static DWORD CALLBACK StarterFunc(void *ptr)
-{
-    ThreadInfo *inf = (ThreadInfo*)ptr;
-    ALint ret;
+	void protect()
+	{
+		old_ctx = (alcGetThreadContext ? alcGetThreadContext() : NULL);
+		thread_ctx = old_ctx;
+		// A thread context is already the current context, so it's kept
+		cur_ctx = (old_ctx ? old_ctx : alcGetCurrentContext());
+		set(cur_ctx);
+	}
 
-    ret = inf->func(inf->ptr);
-    ExitThread((DWORD)ret);
+	void unprotect()
+	{
+		if(!set(old_ctx))
+			set(NULL);
+	}
 
-    return (DWORD)ret;
-}
+	// Sets the thread context, if it isn't already. Returns false on error.
+	bool set(ALCcontext *ctx)
+	{
+		if(!alcSetThreadContext || ctx == thread_ctx)
+			return true;
+		if(alcSetThreadContext(ctx) == ALC_FALSE)
+			return false;
+		thread_ctx = ctx;
+		return true;
+	}
 
-static ThreadInfo *StartThread(ALuint (*func)(ALvoid*), ALvoid *ptr)
-{
-    DWORD dummy;
-    ThreadInfo *inf = new ThreadInfo;
-    inf->func = func;
-    inf->ptr = ptr;
-
-    inf->thread = CreateThread(NULL, 0, StarterFunc, inf, 0, &dummy);
-    if(!inf->thread)
-    {
-        delete inf;
-        return NULL;
-    }
-
-    return inf;
-}
+	// The current context when protect() was called
+	ALCcontext *context() const
+	{ return cur_ctx; }
 
-static ALuint StopThread(ThreadInfo *inf)
-{
-    WaitForSingleObject(inf->thread, INFINITE);
-    CloseHandle(inf->thread);
-    delete inf;
+private:
+	ALCcontext *old_ctx;
+	ALCcontext *thread_ctx;
+	ALCcontext *cur_ctx;
+};
+#define PROTECT_CONTEXT()  ProtectContext _ctx_prot
+#define DO_UNPROTECT()     _ctx_prot.unprotect()
+#define SET_CONTEXT(ctx)   _ctx_prot.set(ctx)
+#define CURRENT_CONTEXT()  _ctx_prot.context()
+
+// A decoded chunk. Data the stream has mapped in memory is pointed at, since
+// it stays put for as long as the stream does; anything else is copied.
+struct DecodedChunk {
+	const ALubyte *data;
+	ALuint length;
+	std::vector<ALubyte> copy;
+
+	DecodedChunk() : data(NULL), length(0)
+	{ }
+};
 
-    return 0;
-}
+struct DecodeJob;
+typedef std::multimap<alureUInt64,DecodeJob*> DecodeQueueMap;
 
-#else
+// A playing stream's decoding. Chunks are decoded ahead by the decode pool,
+// into a ring holding up to one chunk per buffer, and alureUpdate only has to
+// upload them. The ring counts, queue position, and state are guarded by
+// cs_DecodePool. A worker holds decodeLock while it uses the stream, and
+// decodeLock is never taken after cs_DecodePool.
+struct DecodeJob {
+	alureStream *stream;
+	ALuint align;
+	ALsizei loopcount;
+	ALsizei maxloops;
 
-typedef struct {
-    ALuint (*func)(ALvoid*);
-    ALvoid *ptr;
-    pthread_t thread;
-} ThreadInfo;
+	std::vector<DecodedChunk> chunks;
+	size_t readyStart;
+	size_t readyCount;
+	// Set once the stream has no more data
+	bool finished;
 
-static void *StarterFunc(void *ptr)
+	// Time the next chunk is needed by, and how long a chunk plays for, in
+	// microseconds
+	alureUInt64 deadline;
+	alureUInt64 chunkTime;
+
+	enum {
+		Idle,
+		Queued,
+		Decoding
+	} state;
+	bool cancelled;
+	DecodeQueueMap::iterator queuePos;
+	CRITICAL_SECTION decodeLock;
+
+	DecodeJob(alureStream *_stream, ALuint _align, ALsizei _maxloops, ALsizei numChunks)
+	  : stream(_stream), align(_align), loopcount(0), maxloops(_maxloops),
+	    chunks(numChunks), readyStart(0), readyCount(0), finished(false),
+	    deadline(0), chunkTime(0), state(Idle), cancelled(false)
+	{ InitializeCriticalSection(&decodeLock); }
+	~DecodeJob()
+	{ DeleteCriticalSection(&decodeLock); }
+
+	// Decodes the next chunk into dst, rewinding the stream for any loops.
+	// Returns false at the end.
+	bool DecodeChunk(DecodedChunk &dst)
+	{
+		bool rewound = false;
+		while(1)
+		{
+			const ALubyte *chunk;
+			ALuint got = stream->GetChunk(&chunk);
+			got -= got%align;
+			if(got > 0)
+			{
+				if(chunk == &stream->dataChunk[0])
+				{
+					dst.copy.assign(chunk, chunk+got);
+					chunk = &dst.copy[0];
+				}
+				dst.data = chunk;
+				dst.length = got;
+				return true;
+			}
+			// Don't keep looping a stream with nothing in it
+			if(rewound || loopcount == maxloops)
+				return false;
+			if(maxloops != -1)
+				loopcount++;
+			if(!stream->Rewind())
+				return false;
+			rewound = true;
+		}
+	}
+};
+
+// Jobs waiting for a worker, keyed by deadline. Guarded by cs_DecodePool, as
+// are the worker slots. It's allocated when first needed, so it doesn't go
+// away before the streams do at exit.
+static DecodeQueueMap *DecodeQueue = NULL;
+
+struct DecodeThread {
+	ThreadInfo *thread;
+	bool running;
+};
+static DecodeThread *DecodeThreads = NULL;
+static ALuint DecodeThreadCount = 0;
+
+// Adds the job to the queue by its deadline. Must be called with
+// cs_DecodePool held.
+static void queue_job(DecodeJob *job)
 {
-    ThreadInfo *inf = (ThreadInfo*)ptr;
-    void *ret = (void*)(inf->func(inf->ptr));
-    return ret;
+	if(!DecodeQueue)
+		DecodeQueue = new DecodeQueueMap;
+	job->queuePos = DecodeQueue->insert(std::make_pair(job->deadline, job));
+	job->state = DecodeJob::Queued;
 }
 
-static ThreadInfo *StartThread(ALuint (*func)(ALvoid*), ALvoid *ptr)
+// Takes the job off the queue. Must be called with cs_DecodePool held.
+static void unqueue_job(DecodeJob *job)
 {
-    ThreadInfo *inf = new ThreadInfo;
-    inf->func = func;
-    inf->ptr = ptr;
+	DecodeQueue->erase(job->queuePos);
+	job->state = DecodeJob::Idle;
+}
 
-    if(pthread_create(&inf->thread, NULL, StarterFunc, inf) != 0)
-    {
-        delete inf;
-        return NULL;
-    }
+static ALuint DecodeWorker(ALvoid *ptr)
+{
+	DecodeThread *self = static_cast<DecodeThread*>(ptr);
 
-    return inf;
+	EnterCriticalSection(&cs_DecodePool);
+	while(!DecodeQueue->empty())
+	{
+		DecodeJob *job = DecodeQueue->begin()->second;
+		DecodeQueue->erase(DecodeQueue->begin());
+		job->state = DecodeJob::Decoding;
+		LeaveCriticalSection(&cs_DecodePool);
+
+		// Only ready chunks are read by the update thread, so the one after
+		// them is free to decode into. The application may have reset the
+		// ring before the lock was had, so it's only looked at after.
+		EnterCriticalSection(&job->decodeLock);
+		EnterCriticalSection(&cs_DecodePool);
+		DecodedChunk &dst = job->chunks[(job->readyStart+job->readyCount) %
+		                                job->chunks.size()];
+		LeaveCriticalSection(&cs_DecodePool);
+		bool got = job->DecodeChunk(dst);
+
+		EnterCriticalSection(&cs_DecodePool);
+		LeaveCriticalSection(&job->decodeLock);
+		job->state = DecodeJob::Idle;
+		if(got)
+			job->readyCount++;
+		else
+			job->finished = true;
+		if(!job->cancelled && !job->finished &&
+		   job->readyCount < job->chunks.size())
+		{
+			job->deadline += job->chunkTime;
+			queue_job(job);
+		}
+	}
+	self->running = false;
+	LeaveCriticalSection(&cs_DecodePool);
+	return 0;
 }
 
-static ALuint StopThread(ThreadInfo *inf)
+// Makes sure there's a worker running for each queued job, up to one per
+// processor. Must be called with cs_DecodePool held.
+static void start_workers(void)
 {
-    pthread_join(inf->thread, NULL);
-    delete inf;
+	ALuint waiting = (DecodeQueue ? DecodeQueue->size() : 0);
+	if(waiting == 0)
+		return;
 
-    return 0;
-}
+	if(!DecodeThreads)
+	{
+		DecodeThreadCount = std::max<ALuint>(GetProcessorCount(), 1);
+		DecodeThreads = new DecodeThread[DecodeThreadCount];
+		for(ALuint i = 0;i < DecodeThreadCount;i++)
+		{
+			DecodeThreads[i].thread = NULL;
+			DecodeThreads[i].running = false;
+		}
+	}
 
-#endif
+	for(ALuint i = 0;i < DecodeThreadCount;i++)
+	{
+		if(DecodeThreads[i].running)
+		{
+			if(waiting > 0) waiting--;
+			continue;
+		}
+		if(waiting == 0)
+			continue;
 
-// This object is used to make sure the current context isn't switched out on
-// us by another thread, by setting the current thread context to the current
-// context. The old thread context is then restored when the object goes out
-// of scope.
-// This obviously only works when ALC_EXT_thread_local_context is supported
-struct ProtectContext {
-	ProtectContext()
-	{ protect(); }
+		if(DecodeThreads[i].thread)
+			StopThread(DecodeThreads[i].thread);
+		DecodeThreads[i].thread = StartThread(DecodeWorker, &DecodeThreads[i]);
+		DecodeThreads[i].running = (DecodeThreads[i].thread != NULL);
+		if(!DecodeThreads[i].running)
+			break;
+		waiting--;
+	}
+}
 
-	~ProtectContext()
-	{ unprotect(); }
+// Schedules the job to decode ahead, if it has room, with the next chunk due
+// by the given time. Must be called with cs_DecodePool held.
+static void schedule_job(DecodeJob *job, alureUInt64 deadline)
+{
+	if(job->finished || job->readyCount >= job->chunks.size())
+		return;
+	if(job->state == DecodeJob::Decoding)
+		return;
 
-	void protect()
+	if(job->state == DecodeJob::Queued)
 	{
-		old_ctx = (alcGetThreadContext ? alcGetThreadContext() : NULL);
-		if(alcSetThreadContext)
-			alcSetThreadContext(alcGetCurrentContext());
+		if(job->deadline == deadline)
+			return;
+		unqueue_job(job);
 	}
+	job->deadline = deadline;
+	queue_job(job);
+}
 
-	void unprotect()
+// Stops the job from being decoded, waiting for a worker using it to finish,
+// and deletes it. Must not be called with cs_DecodePool held.
+static void release_job(DecodeJob *job)
+{
+	EnterCriticalSection(&cs_DecodePool);
+	job->cancelled = true;
+	if(job->state == DecodeJob::Queued)
+		unqueue_job(job);
+	bool decoding = (job->state == DecodeJob::Decoding);
+	LeaveCriticalSection(&cs_DecodePool);
+
+	// The worker holds decodeLock until it's done. It may not have taken it
+	// yet, so check again after getting it.
+	while(decoding)
 	{
-		if(alcSetThreadContext)
-		{
-			if(alcSetThreadContext(old_ctx) == ALC_FALSE)
-				alcSetThreadContext(NULL);
-		}
+		EnterCriticalSection(&job->decodeLock);
+		LeaveCriticalSection(&job->decodeLock);
+
+		EnterCriticalSection(&cs_DecodePool);
+		decoding = (job->state == DecodeJob::Decoding);
+		LeaveCriticalSection(&cs_DecodePool);
 	}
+	delete job;
+}
+
+void StopDecodePool(void)
+{
+	EnterCriticalSection(&cs_DecodePool);
+	DecodeThread *threads = DecodeThreads;
+	ALuint count = DecodeThreadCount;
+	DecodeThreads = NULL;
+	DecodeThreadCount = 0;
+	LeaveCriticalSection(&cs_DecodePool);
+
+	for(ALuint i = 0;i < count;i++)
+	{
+		if(threads[i].thread)
+			StopThread(threads[i].thread);
+	}
+	delete[] threads;
+
+	EnterCriticalSection(&cs_DecodePool);
+	delete DecodeQueue;
+	DecodeQueue = NULL;
+	LeaveCriticalSection(&cs_DecodePool);
+}
 
-private:
-	ALCcontext *old_ctx;
-};
-#define PROTECT_CONTEXT() ProtectContext _ctx_prot
-#define DO_PROTECT()      _ctx_prot.protect()
-#define DO_UNPROTECT()    _ctx_prot.unprotect()
 
 struct AsyncPlayEntry {
 	ALuint source;
 	alureStream *stream;
+	DecodeJob *job;
 	std::vector<ALuint> buffers;
-	ALsizei loopcount;
-	ALsizei maxloops;
+	// Buffers unqueued from the source that are waiting for data
+	std::vector<ALuint> idle;
 	void (*eos_callback)(void*,ALuint);
 	void *user_data;
 	bool finished;
@@ -165,20 +362,16 @@ struct AsyncPlayEntry {
 	ALuint stream_align;
 	ALCcontext *ctx;
 
-	AsyncPlayEntry() : source(0), stream(NULL), loopcount(0), maxloops(0),
-	                   eos_callback(NULL), user_data(NULL), finished(false),
-	                   paused(false), stream_freq(0), stream_format(AL_NONE),
-	                   stream_align(0), ctx(NULL)
-	{ }
-	AsyncPlayEntry(const AsyncPlayEntry &rhs)
-	  : source(rhs.source), stream(rhs.stream), buffers(rhs.buffers),
-	    loopcount(rhs.loopcount), maxloops(rhs.maxloops),
-	    eos_callback(rhs.eos_callback), user_data(rhs.user_data),
-	    finished(rhs.finished), paused(rhs.paused),
-	    stream_freq(rhs.stream_freq), stream_format(rhs.stream_format),
-	    stream_align(rhs.stream_align), ctx(rhs.ctx)
+	AsyncPlayEntry() : source(0), stream(NULL), job(NULL), eos_callback(NULL),
+	                   user_data(NULL), finished(false), paused(false),
+	                   stream_freq(0), stream_format(AL_NONE), stream_align(0),
+	                   ctx(NULL)
 	{ }
 
+	// Hands the source's played buffers back to it with decoded chunks, and
+	// schedules the next chunks to be decoded by the time the queued data
+	// runs out. The workers are left for the caller to start. cs_DecodePool
+	// is only held to look at and update the ring, not while calling into AL.
 	ALenum Update(ALint *queued)
 	{
 		ALint processed, state;
@@ -190,37 +383,181 @@ struct AsyncPlayEntry {
 			ALuint buf;
 
 			alSourceUnqueueBuffers(source, 1, &buf);
+			idle.push_back(buf);
 			processed--;
+		}
 
-			while(!finished)
-			{
-				ALuint got = stream->GetData(&stream->dataChunk[0], stream->dataChunk.size());
-				got -= got%stream_align;
-				if(got > 0)
-				{
-					alBufferData(buf, stream_format, &stream->dataChunk[0], got, stream_freq);
-					alSourceQueueBuffers(source, 1, &buf);
+		// Workers only write past the ready chunks, so they can be read
+		// without the lock
+		EnterCriticalSection(&cs_DecodePool);
+		size_t start = job->readyStart;
+		size_t ready = job->readyCount;
+		LeaveCriticalSection(&cs_DecodePool);
 
-					break;
-				}
-				if(loopcount == maxloops)
-				{
-					finished = true;
-					break;
-				}
-				if(maxloops != -1)
-					loopcount++;
-				finished = !stream->Rewind();
-			}
+		size_t used = 0;
+		while(used < ready && !idle.empty())
+		{
+			const DecodedChunk &chunk = job->chunks[(start+used) % job->chunks.size()];
+			ALuint buf = idle.front();
+			idle.erase(idle.begin());
+			alBufferData(buf, stream_format, chunk.data, chunk.length, stream_freq);
+			alSourceQueueBuffers(source, 1, &buf);
+			used++;
 		}
 
+		EnterCriticalSection(&cs_DecodePool);
+		job->readyStart = (job->readyStart+used) % job->chunks.size();
+		job->readyCount -= used;
+		finished = (job->finished && job->readyCount == 0);
+		LeaveCriticalSection(&cs_DecodePool);
+
 		alGetSourcei(source, AL_BUFFERS_QUEUED, queued);
+		if(!finished)
+		{
+			ALint offset = 0;
+			alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+
+			alureUInt64 left = alureUInt64(*queued) * job->chunkTime;
+			alureUInt64 played = alureUInt64(std::max(offset, 0)) * 1000000 /
+			                     stream_freq;
+			alureUInt64 deadline = GetTimeUS() + left - std::min(played, left);
+
+			EnterCriticalSection(&cs_DecodePool);
+			schedule_job(job, deadline);
+			LeaveCriticalSection(&cs_DecodePool);
+		}
+
 		return state;
 	}
 };
-static std::list<AsyncPlayEntry> AsyncPlayList;
+// Entries are only ever spliced between lists, never copied, so iterators
+// stay valid for the indexes. Guarded by cs_StreamPlay, as are the indexes.
+// None of these are ever deleted, since deinit_alure stops the streams still
+// playing after static objects may have been destroyed.
+typedef std::list<AsyncPlayEntry> PlayList;
+static PlayList &AsyncPlayList = *new PlayList;
+
+typedef std::map<std::pair<ALCcontext*,ALuint>,PlayList::iterator> PlaySourceMap;
+typedef std::map<alureStream*,PlayList::iterator> PlayStreamMap;
+static PlaySourceMap &PlaySources = *new PlaySourceMap;
+static PlayStreamMap &PlayStreams = *new PlayStreamMap;
+
+// Entries are kept together by context, so alureUpdate only switches context
+// once for each. This holds the first entry of each context's group.
+typedef std::map<ALCcontext*,PlayList::iterator> PlayContextMap;
+static PlayContextMap &PlayContexts = *new PlayContextMap;
+
 static ThreadInfo *PlayThreadHandle;
 
+// Callbacks waiting for alurePollEvents, oldest first. Guarded by
+// cs_PlayEvents, as is the deferral flag.
+struct PlayEvent {
+	void (*callback)(void*,ALuint);
+	void *user_data;
+	ALuint source;
+	PlayEvent *next;
+};
+static PlayEvent *PlayEventHead = NULL;
+static PlayEvent **PlayEventTail = &PlayEventHead;
+static bool DeferCallbacks = false;
+
+// Returns the entry playing the source on the context, or the end of the list
+static PlayList::iterator find_source(ALCcontext *ctx, ALuint source)
+{
+	PlaySourceMap::iterator i = PlaySources.find(std::make_pair(ctx, source));
+	if(i == PlaySources.end())
+		return AsyncPlayList.end();
+	return i->second;
+}
+
+// Moves the (single) entry in the list to the front of its context's group in
+// the play list, and indexes it
+static void add_entry(PlayList &entry)
+{
+	PlayList::iterator i = entry.begin();
+	PlayContextMap::iterator group = PlayContexts.find(i->ctx);
+	if(group != PlayContexts.end())
+	{
+		AsyncPlayList.splice(group->second, entry);
+		group->second = i;
+	}
+	else
+	{
+		AsyncPlayList.splice(AsyncPlayList.begin(), entry);
+		PlayContexts[i->ctx] = i;
+	}
+
+	PlaySources[std::make_pair(i->ctx, i->source)] = i;
+	if(i->stream)
+		PlayStreams[i->stream] = i;
+}
+
+// Moves the entry from the play list to the end of the given list
+static void remove_entry(PlayList::iterator i, PlayList &dst)
+{
+	PlayContextMap::iterator group = PlayContexts.find(i->ctx);
+	if(group->second == i)
+	{
+		PlayList::iterator next = i;
+		if(++next != AsyncPlayList.end() && next->ctx == i->ctx)
+			group->second = next;
+		else
+			PlayContexts.erase(group);
+	}
+
+	PlaySources.erase(std::make_pair(i->ctx, i->source));
+	if(i->stream)
+		PlayStreams.erase(i->stream);
+	dst.splice(dst.end(), AsyncPlayList, i);
+}
+
+// Calls the callbacks of the ended entries, or queues them for
+// alurePollEvents if they're deferred. Must not be called with cs_StreamPlay
+// held, so the callbacks are free to do as they please.
+static void dispatch_callbacks(const PlayList &ended)
+{
+	PlayList::const_iterator i;
+
+	EnterCriticalSection(&cs_PlayEvents);
+	if(DeferCallbacks)
+	{
+		for(i = ended.begin();i != ended.end();i++)
+		{
+			if(!i->eos_callback)
+				continue;
+			PlayEvent *evt = new PlayEvent;
+			evt->callback = i->eos_callback;
+			evt->user_data = i->user_data;
+			evt->source = i->source;
+			evt->next = NULL;
+			*PlayEventTail = evt;
+			PlayEventTail = &evt->next;
+		}
+		LeaveCriticalSection(&cs_PlayEvents);
+		return;
+	}
+	LeaveCriticalSection(&cs_PlayEvents);
+
+	for(i = ended.begin();i != ended.end();i++)
+	{
+		if(i->eos_callback)
+			i->eos_callback(i->user_data, i->source);
+	}
+}
+
+void ClearPlayEvents(void)
+{
+	EnterCriticalSection(&cs_PlayEvents);
+	while(PlayEventHead)
+	{
+		PlayEvent *evt = PlayEventHead;
+		PlayEventHead = evt->next;
+		delete evt;
+	}
+	PlayEventTail = &PlayEventHead;
+	LeaveCriticalSection(&cs_PlayEvents);
+}
+
 ALfloat CurrentInterval = 0.0f;
 
 ALuint AsyncPlayFunc(ALvoid*)
@@ -228,7 +565,10 @@ ALuint AsyncPlayFunc(ALvoid*)
 	EnterCriticalSection(&cs_StreamPlay);
 	while(CurrentInterval > 0.0f)
 	{
+		// Not holding the lock, so callbacks are called without it
+		LeaveCriticalSection(&cs_StreamPlay);
 		alureUpdate();
+		EnterCriticalSection(&cs_StreamPlay);
 
 		ALfloat interval = CurrentInterval;
 		LeaveCriticalSection(&cs_StreamPlay);
@@ -242,44 +582,74 @@ ALuint AsyncPlayFunc(ALvoid*)
 
 void StopStream(alureStream *stream)
 {
+	PlayList removed;
 	EnterCriticalSection(&cs_StreamPlay);
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
+	PlayStreamMap::iterator i = PlayStreams.find(stream);
+	if(i != PlayStreams.end())
 	{
-		if(i->stream == stream)
+		remove_entry(i->second, removed);
+		AsyncPlayEntry &ent = removed.front();
+
+		ALCcontext *old_ctx = (alcGetThreadContext ?
+		                       alcGetThreadContext() : NULL);
+		if(alcSetThreadContext)
 		{
-			AsyncPlayEntry ent(*i);
-			AsyncPlayList.erase(i);
+			if(alcSetThreadContext(ent.ctx) == ALC_FALSE)
+				goto ctx_err;
+		}
 
-			ALCcontext *old_ctx = (alcGetThreadContext ?
-			                       alcGetThreadContext() : NULL);
-			if(alcSetThreadContext)
-			{
-				if(alcSetThreadContext(ent.ctx) == ALC_FALSE)
-					goto ctx_err;
-			}
+		alSourceStop(ent.source);
+		alSourcei(ent.source, AL_BUFFER, 0);
+		alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
+		alGetError();
 
-			alSourceStop(ent.source);
-			alSourcei(ent.source, AL_BUFFER, 0);
-			alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
-			alGetError();
+		if(alcSetThreadContext)
+		{
+			if(alcSetThreadContext(old_ctx) == ALC_FALSE)
+				alcSetThreadContext(NULL);
+		}
 
-			if(alcSetThreadContext)
-			{
-				if(alcSetThreadContext(old_ctx) == ALC_FALSE)
-					alcSetThreadContext(NULL);
-			}
+	ctx_err:
+		release_job(ent.job);
+	}
 
-		ctx_err:
-			if(ent.eos_callback)
-				ent.eos_callback(ent.user_data, ent.source);
-			break;
+	LeaveCriticalSection(&cs_StreamPlay);
+
+	dispatch_callbacks(removed);
+}
+
+
+// Keeps the decode pool and alureUpdate off the stream while the application
+// uses it, if it's playing. Must be paired with UnlockStreamDecode.
+void LockStreamDecode(alureStream *stream)
+{
+	EnterCriticalSection(&cs_StreamPlay);
+	PlayStreamMap::iterator i = PlayStreams.find(stream);
+	if(i != PlayStreams.end())
+		EnterCriticalSection(&i->second->job->decodeLock);
+}
+
+// Lets the stream be decoded again. Discarding drops the chunks decoded ahead
+// of the stream's position, after it's been moved, and has the next ones
+// decoded right away.
+void UnlockStreamDecode(alureStream *stream, bool discard)
+{
+	PlayStreamMap::iterator i = PlayStreams.find(stream);
+	if(i != PlayStreams.end())
+	{
+		DecodeJob *job = i->second->job;
+		if(discard)
+		{
+			EnterCriticalSection(&cs_DecodePool);
+			job->readyCount = 0;
+			job->finished = false;
+			schedule_job(job, GetTimeUS());
+			start_workers();
+			LeaveCriticalSection(&cs_DecodePool);
 		}
-		i++;
+		LeaveCriticalSection(&job->decodeLock);
 	}
-
 	LeaveCriticalSection(&cs_StreamPlay);
 }
 
@@ -300,6 +670,14 @@ extern "C" {
  * automatically restarted. Instead, set a flag using the callback to indicate
  * the stream being stopped.
  *
+ * After the first buffers are filled, the stream is decoded ahead on a pool of
+ * background threads, one per processor, with the streams closest to running
+ * out of queued data decoded first. <alureUpdate> then only has to queue the
+ * decoded data. The stream may still be rewound or seeked while it's playing,
+ * with <alureRewindStream>, <alureSetStreamOrder>, or <alureSetStreamOffset>.
+ * Data decoded ahead is then dropped, and playback continues from the new
+ * position once the buffers already queued on the source have played.
+ *
  * Parameters:
  * source - The source ID to play the stream with. Any buffers on the source
  *          will be unqueued. It is valid to set source properties not related
@@ -323,7 +701,9 @@ extern "C" {
  * eos_callback - This callback will be called when the stream reaches the end,
  *                no more loops are pending, and the source reaches a stopped
  *                state. It will also be called if an error occured and
- *                playback terminated.
+ *                playback terminated. It's called without any of the
+ *                library's locks held, or queued for <alurePollEvents> if
+ *                callbacks are deferred with <alureDeferCallbacks>.
  * userdata - An opaque user pointer passed to the callback.
  *
  * Returns:
@@ -339,7 +719,7 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
     void (*eos_callback)(void *userdata, ALuint source), void *userdata)
 {
 	PROTECT_CONTEXT();
-	ALCcontext *current_ctx = alcGetCurrentContext();
+	ALCcontext *current_ctx = CURRENT_CONTEXT();
 
 	if(alGetError() != AL_NO_ERROR)
 	{
@@ -367,29 +747,23 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
 
 	EnterCriticalSection(&cs_StreamPlay);
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
+	if(PlayStreams.find(stream) != PlayStreams.end())
 	{
-		if(i->stream == stream)
-		{
-			SetError("Stream is already playing");
-			LeaveCriticalSection(&cs_StreamPlay);
-			return AL_FALSE;
-		}
-		if(i->source == source && i->ctx == current_ctx)
-		{
-			SetError("Source is already playing");
-			LeaveCriticalSection(&cs_StreamPlay);
-			return AL_FALSE;
-		}
-		i++;
+		SetError("Stream is already playing");
+		LeaveCriticalSection(&cs_StreamPlay);
+		return AL_FALSE;
+	}
+	if(find_source(current_ctx, source) != AsyncPlayList.end())
+	{
+		SetError("Source is already playing");
+		LeaveCriticalSection(&cs_StreamPlay);
+		return AL_FALSE;
 	}
 
-	AsyncPlayEntry ent;
+	PlayList added(1);
+	AsyncPlayEntry &ent = added.front();
 	ent.stream = stream;
 	ent.source = source;
-	ent.maxloops = loopcount;
 	ent.eos_callback = eos_callback;
 	ent.user_data = userdata;
 	ent.ctx = current_ctx;
@@ -403,36 +777,28 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
 		return AL_FALSE;
 	}
 
+	// The first buffers are filled here, and the rest is decoded ahead by the
+	// decode pool as they play
 	numBufs = 0;
-	if(ent.stream->GetFormat(&ent.stream_format, &ent.stream_freq, &ent.stream_align))
+	if(ent.stream->GetFormat(&ent.stream_format, &ent.stream_freq, &ent.stream_align) &&
+	   ent.stream_freq > 0 && ent.stream_align > 0)
 	{
-		for(size_t i = 0;i < ent.buffers.size();i++)
+		ent.job = new DecodeJob(stream, ent.stream_align, loopcount, ent.buffers.size());
+		ent.job->chunkTime = alureUInt64(stream->dataChunk.size()) / ent.stream_align *
+		                     DetectCompressionRate(ent.stream_format) * 1000000 /
+		                     ent.stream_freq;
+		DecodedChunk &chunk = ent.job->chunks[0];
+		while(numBufs < ALsizei(ent.buffers.size()) && ent.job->DecodeChunk(chunk))
 		{
-			ALuint got = ent.stream->GetData(&ent.stream->dataChunk[0],
-			                                 ent.stream->dataChunk.size());
-			got -= got%ent.stream_align;
-			if(got <= 0)
-			{
-				if(ent.loopcount == ent.maxloops || i == 0)
-					ent.finished = true;
-				else
-				{
-					if(ent.maxloops != -1)
-						ent.loopcount++;
-					ent.finished = !ent.stream->Rewind();
-				}
-				if(ent.finished)
-					break;
-				i--;
-				continue;
-			}
-			ALuint buf = ent.buffers[i];
-			alBufferData(buf, ent.stream_format, &ent.stream->dataChunk[0], got, ent.stream_freq);
+			alBufferData(ent.buffers[numBufs], ent.stream_format, chunk.data,
+			             chunk.length, ent.stream_freq);
 			numBufs++;
 		}
+		ent.job->finished = (numBufs < ALsizei(ent.buffers.size()));
 	}
 	if(numBufs == 0)
 	{
+		delete ent.job;
 		alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
 		alGetError();
 		LeaveCriticalSection(&cs_StreamPlay);
@@ -445,6 +811,7 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
 	   (alSourceQueueBuffers(source, numBufs, &ent.buffers[0]),
 	    alSourcePlay(source),alGetError()) != AL_NO_ERROR)
 	{
+		delete ent.job;
 		alSourcei(source, AL_BUFFER, 0);
 		alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
 		alGetError();
@@ -452,8 +819,14 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
 		SetError("Error starting source");
 		return AL_FALSE;
 	}
+	ent.idle.reserve(ent.buffers.size());
 
-	AsyncPlayList.push_front(ent);
+	EnterCriticalSection(&cs_DecodePool);
+	schedule_job(ent.job, GetTimeUS() + numBufs*ent.job->chunkTime);
+	start_workers();
+	LeaveCriticalSection(&cs_DecodePool);
+
+	add_entry(added);
 
 	LeaveCriticalSection(&cs_StreamPlay);
 
@@ -477,7 +850,9 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySourceStream(ALuint source,
  *          and restarting a paused source is allowed, and the callback will
  *          still be called when the source reaches an AL_STOPPED or AL_INITIAL
  *          state.
- * callback - The callback to be called when the source stops.
+ * callback - The callback to be called when the source stops. As with
+ *            <alurePlaySourceStream>, it may be deferred with
+ *            <alureDeferCallbacks>.
  * userdata - An opaque user pointer passed to the callback.
  *
  * Returns:
@@ -492,7 +867,7 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySource(ALuint source,
     void (*callback)(void *userdata, ALuint source), void *userdata)
 {
 	PROTECT_CONTEXT();
-	ALCcontext *current_ctx = alcGetCurrentContext();
+	ALCcontext *current_ctx = CURRENT_CONTEXT();
 
 	if(alGetError() != AL_NO_ERROR)
 	{
@@ -502,17 +877,11 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySource(ALuint source,
 
 	EnterCriticalSection(&cs_StreamPlay);
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
+	if(find_source(current_ctx, source) != AsyncPlayList.end())
 	{
-		if(i->source == source && i->ctx == current_ctx)
-		{
-			SetError("Source is already playing");
-			LeaveCriticalSection(&cs_StreamPlay);
-			return AL_FALSE;
-		}
-		i++;
+		SetError("Source is already playing");
+		LeaveCriticalSection(&cs_StreamPlay);
+		return AL_FALSE;
 	}
 
 	if((alSourcePlay(source),alGetError()) != AL_NO_ERROR)
@@ -522,14 +891,20 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySource(ALuint source,
 		return AL_FALSE;
 	}
 
+	ALint buffer = 0;
+	alGetSourcei(source, AL_BUFFER, &buffer);
+	if(buffer != 0)
+		MarkBufferUsed(buffer);
+
 	if(callback != NULL)
 	{
-		AsyncPlayEntry ent;
+		PlayList added(1);
+		AsyncPlayEntry &ent = added.front();
 		ent.source = source;
 		ent.eos_callback = callback;
 		ent.user_data = userdata;
 		ent.ctx = current_ctx;
-		AsyncPlayList.push_front(ent);
+		add_entry(added);
 	}
 
 	LeaveCriticalSection(&cs_StreamPlay);
@@ -556,7 +931,7 @@ ALURE_API ALboolean ALURE_APIENTRY alurePlaySource(ALuint source,
 ALURE_API ALboolean ALURE_APIENTRY alureStopSource(ALuint source, ALboolean run_callback)
 {
 	PROTECT_CONTEXT();
-	ALCcontext *current_ctx = alcGetCurrentContext();
+	ALCcontext *current_ctx = CURRENT_CONTEXT();
 
 	if(alGetError() != AL_NO_ERROR)
 	{
@@ -573,35 +948,31 @@ ALURE_API ALboolean ALURE_APIENTRY alureStopSource(ALuint source, ALboolean run_
 		return AL_FALSE;
 	}
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
+	PlayList removed;
+	PlayList::iterator i = find_source(current_ctx, source);
+	if(i != AsyncPlayList.end())
 	{
-		if(i->source == source && i->ctx == current_ctx)
-		{
-			AsyncPlayEntry ent(*i);
-			AsyncPlayList.erase(i);
+		remove_entry(i, removed);
+		AsyncPlayEntry &ent = removed.front();
 
-			if(ent.buffers.size() > 0)
-			{
-				alSourcei(ent.source, AL_BUFFER, 0);
-				alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
-				alGetError();
-			}
-
-			if(run_callback && ent.eos_callback)
-			{
-				DO_UNPROTECT();
-				ent.eos_callback(ent.user_data, ent.source);
-				DO_PROTECT();
-			}
-			break;
+		if(ent.buffers.size() > 0)
+		{
+			alSourcei(ent.source, AL_BUFFER, 0);
+			alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
+			alGetError();
 		}
-		i++;
+		if(ent.job)
+			release_job(ent.job);
 	}
 
 	LeaveCriticalSection(&cs_StreamPlay);
 
+	if(run_callback && !removed.empty())
+	{
+		DO_UNPROTECT();
+		dispatch_callbacks(removed);
+	}
+
 	return AL_TRUE;
 }
 
@@ -626,7 +997,7 @@ ALURE_API ALboolean ALURE_APIENTRY alureStopSource(ALuint source, ALboolean run_
 ALURE_API ALboolean ALURE_APIENTRY alurePauseSource(ALuint source)
 {
 	PROTECT_CONTEXT();
-	ALCcontext *current_ctx = alcGetCurrentContext();
+	ALCcontext *current_ctx = CURRENT_CONTEXT();
 
 	if(alGetError() != AL_NO_ERROR)
 	{
@@ -643,17 +1014,9 @@ ALURE_API ALboolean ALURE_APIENTRY alurePauseSource(ALuint source)
 		return AL_FALSE;
 	}
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
-	{
-		if(i->source == source && i->ctx == current_ctx)
-		{
-			i->paused = true;
-			break;
-		}
-		i++;
-	}
+	PlayList::iterator i = find_source(current_ctx, source);
+	if(i != AsyncPlayList.end())
+		i->paused = true;
 
 	LeaveCriticalSection(&cs_StreamPlay);
 
@@ -675,7 +1038,7 @@ ALURE_API ALboolean ALURE_APIENTRY alurePauseSource(ALuint source)
 ALURE_API ALboolean ALURE_APIENTRY alureResumeSource(ALuint source)
 {
 	PROTECT_CONTEXT();
-	ALCcontext *current_ctx = alcGetCurrentContext();
+	ALCcontext *current_ctx = CURRENT_CONTEXT();
 
 	if(alGetError() != AL_NO_ERROR)
 	{
@@ -692,17 +1055,9 @@ ALURE_API ALboolean ALURE_APIENTRY alureResumeSource(ALuint source)
 		return AL_FALSE;
 	}
 
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	while(i != end)
-	{
-		if(i->source == source && i->ctx == current_ctx)
-		{
-			i->paused = false;
-			break;
-		}
-		i++;
-	}
+	PlayList::iterator i = find_source(current_ctx, source);
+	if(i != AsyncPlayList.end())
+		i->paused = false;
 
 	LeaveCriticalSection(&cs_StreamPlay);
 
@@ -714,78 +1069,90 @@ ALURE_API ALboolean ALURE_APIENTRY alureResumeSource(ALuint source)
  * Updates the running list of streams, and checks for stopped sources. This
  * makes sure that sources played with <alurePlaySourceStream> are kept fed
  * from their associated stream, and sources played with <alurePlaySource> are
- * still playing. It will call their callbacks as needed.
+ * still playing. It also finishes buffers loaded with
+ * <alureCreateBufferFromFileAsync> and <alureCreateBufferFromMemoryAsync>. It
+ * will call their callbacks as needed.
  *
  * *Version Added*: 1.1
  *
  * See Also:
- * <alurePlaySourceStream>, <alurePlaySource>
+ * <alurePlaySourceStream>, <alurePlaySource>,
+ * <alureCreateBufferFromFileAsync>
  */
 ALURE_API void ALURE_APIENTRY alureUpdate(void)
 {
+	UpdateBufferLoads();
+
 	PROTECT_CONTEXT();
 
 	EnterCriticalSection(&cs_StreamPlay);
-restart:
-	std::list<AsyncPlayEntry>::iterator i = AsyncPlayList.begin(),
-	                                    end = AsyncPlayList.end();
-	for(;i != end;i++)
+
+	// Entries that ended are moved here, and their callbacks are called once
+	// the whole list has been updated and the lock released
+	PlayList ended;
+
+	PlayList::iterator i = AsyncPlayList.begin(),
+	                   end = AsyncPlayList.end();
+	ALCcontext *ctx_group = NULL;
+	bool ctx_set = false, ctx_valid = false;
+	while(i != end)
 	{
-		if(alcSetThreadContext)
+		PlayList::iterator cur = i++;
+
+		// Entries are grouped by context, so it only needs to be set at the
+		// start of each group
+		if(!ctx_set || cur->ctx != ctx_group)
 		{
-			if(alcSetThreadContext(i->ctx) == ALC_FALSE)
-			{
-				AsyncPlayEntry ent(*i);
-				AsyncPlayList.erase(i);
-				if(ent.eos_callback)
-				{
-					DO_UNPROTECT();
-					ent.eos_callback(ent.user_data, ent.source);
-					DO_PROTECT();
-				}
-				goto restart;
-			}
+			ctx_group = cur->ctx;
+			ctx_valid = SET_CONTEXT(ctx_group);
+			ctx_set = true;
+		}
+		if(!ctx_valid)
+		{
+			remove_entry(cur, ended);
+			if(cur->job)
+				release_job(cur->job);
+			continue;
 		}
 
-		if(i->stream == NULL)
+		if(cur->stream == NULL)
 		{
 			ALint state;
-			alGetSourcei(i->source, AL_SOURCE_STATE, &state);
+			alGetSourcei(cur->source, AL_SOURCE_STATE, &state);
 			if(state == AL_STOPPED || state == AL_INITIAL)
-			{
-				AsyncPlayEntry ent(*i);
-				AsyncPlayList.erase(i);
-				DO_UNPROTECT();
-				ent.eos_callback(ent.user_data, ent.source);
-				DO_PROTECT();
-				goto restart;
-			}
+				remove_entry(cur, ended);
 			continue;
 		}
 
 		ALint queued;
-		if(i->Update(&queued) != AL_PLAYING)
+		if(cur->Update(&queued) != AL_PLAYING)
 		{
-			if(queued == 0)
+			if(queued == 0 && cur->finished)
 			{
-				AsyncPlayEntry ent(*i);
-				AsyncPlayList.erase(i);
+				remove_entry(cur, ended);
 
-				alSourcei(ent.source, AL_BUFFER, 0);
-				alDeleteBuffers(ent.buffers.size(), &ent.buffers[0]);
-				if(ent.eos_callback)
-				{
-					DO_UNPROTECT();
-					ent.eos_callback(ent.user_data, ent.source);
-					DO_PROTECT();
-				}
-				goto restart;
+				alSourcei(cur->source, AL_BUFFER, 0);
+				alDeleteBuffers(cur->buffers.size(), &cur->buffers[0]);
+				release_job(cur->job);
+				continue;
 			}
-			if(!i->paused)
-				alSourcePlay(i->source);
+			if(queued > 0 && !cur->paused)
+				alSourcePlay(cur->source);
 		}
 	}
+
+	// Workers are started once for all the jobs scheduled above
+	EnterCriticalSection(&cs_DecodePool);
+	start_workers();
+	LeaveCriticalSection(&cs_DecodePool);
+
 	LeaveCriticalSection(&cs_StreamPlay);
+
+	if(!ended.empty())
+	{
+		DO_UNPROTECT();
+		dispatch_callbacks(ended);
+	}
 }
 
 /* Function: alureUpdateInterval
@@ -835,4 +1202,66 @@ ALURE_API ALboolean ALURE_APIENTRY alureUpdateInterval(ALfloat interval)
 	return AL_TRUE;
 }
 
+/* Function: alureDeferCallbacks
+ *
+ * Sets whether the callbacks given to <alurePlaySourceStream> and
+ * <alurePlaySource> are deferred. Normally they're called by <alureUpdate> or
+ * <alureStopSource>, on whichever thread calls them. When deferred, they're
+ * queued instead, and the application calls them with <alurePollEvents> when
+ * and where it's convenient, such as its main loop. This keeps the update
+ * thread set up by <alureUpdateInterval> from running application code.
+ * Callbacks already queued when deferral is turned off stay queued until
+ * polled.
+ *
+ * Returns:
+ * AL_FALSE on error.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alurePollEvents>
+ */
+ALURE_API ALboolean ALURE_APIENTRY alureDeferCallbacks(ALboolean defer)
+{
+	EnterCriticalSection(&cs_PlayEvents);
+	DeferCallbacks = !!defer;
+	LeaveCriticalSection(&cs_PlayEvents);
+
+	return AL_TRUE;
+}
+
+/* Function: alurePollEvents
+ *
+ * Calls the callbacks queued while deferred by <alureDeferCallbacks>, in the
+ * order the sources ended. Callbacks queued while they're being called are
+ * left for the next call.
+ *
+ * Returns:
+ * The number of callbacks called.
+ *
+ * *Version Added*: 1.3
+ *
+ * See Also:
+ * <alureDeferCallbacks>
+ */
+ALURE_API ALsizei ALURE_APIENTRY alurePollEvents(void)
+{
+	EnterCriticalSection(&cs_PlayEvents);
+	PlayEvent *evt = PlayEventHead;
+	PlayEventHead = NULL;
+	PlayEventTail = &PlayEventHead;
+	LeaveCriticalSection(&cs_PlayEvents);
+
+	ALsizei count = 0;
+	while(evt)
+	{
+		PlayEvent *next = evt->next;
+		evt->callback(evt->user_data, evt->source);
+		delete evt;
+		evt = next;
+		count++;
+	}
+	return count;
+}
+
 } // extern "C"